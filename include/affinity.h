@@ -0,0 +1,34 @@
+#ifndef SRC_AFFINITY_H_
+#define SRC_AFFINITY_H_
+
+#include <sched.h> // cpu_set_t, needs _GNU_SOURCE
+
+#include <simulator.h> // N_TEAMS, status
+
+#define AFFINITY_SYSFS "/sys/devices/system/cpu"
+
+/* Where each process runs. The simulator and the monitor get a core each,
+ * with their hyperthread siblings left idle if there are CPUs enough. Every
+ * team gets the CPUs of one last level cache domain, shared with the other
+ * teams only if there are fewer domains than teams. */
+typedef struct {
+    int simulator_cpu;
+    int monitor_cpu;
+    cpu_set_t teams[N_TEAMS];
+    int team_domain[N_TEAMS]; // First CPU of the cache domain of the team
+    int n_cpus;               // CPUs this process may use
+    int n_domains;            // Last level cache domains among them
+} affinity_plan_t;
+
+/* Computes the placement from the topology in AFFINITY_SYSFS and the CPUs
+ * allowed to this process. */
+status affinity_plan(affinity_plan_t* plan);
+
+status affinity_pin_cpu(int cpu);
+
+status affinity_pin_set(cpu_set_t* cpus);
+
+/* Prints the placement in stdout. */
+void affinity_report(affinity_plan_t* plan);
+
+#endif /* SRC_AFFINITY_H_ */
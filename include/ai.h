@@ -0,0 +1,53 @@
+#ifndef SRC_AI_H_
+#define SRC_AI_H_
+
+#include <stdbool.h> // bool
+
+#include <simulator.h> // map_t, move_t, spaceship_t
+
+#define AI_NO_TARGET -2 // Target id of a spaceship that holds its fire
+
+/* Random number in [min, max] without modulo bias. */
+unsigned int ai_rand_interval(unsigned int min,
+                              unsigned int max,
+                              unsigned int* seed);
+
+/* Chooses the next command of a leader: MOVE or ATTACK. */
+int ai_leader_action(unsigned int* seed);
+
+/* Returns a random enemy spaceship in range that the team can see, or one
+ * with id -1 if there is none. Only the squares in range are read. */
+spaceship_t ai_locate_enemy(map_t* map,
+                            spaceship_t spaceship,
+                            unsigned int* seed);
+
+/* Assigns a target to every spaceship of team alive for an attack, among the
+ * enemies it sees in range. Spaceships go for the enemies that need fewer
+ * shots to be destroyed, and no enemy gets more shots than it needs. The
+ * ones left without a useful target get id AI_NO_TARGET. Enemies are found
+ * through a grid of buckets, so the cost grows with the pairs in range. */
+void ai_assign_targets(map_t* map, int team, spaceship_t targets[N_SPACESHIPS]);
+
+/* Fills move with an attack of spaceship to the enemy assigned by its
+ * leader. If that enemy is no longer alive, seen or in range, or the leader
+ * did not choose (id -1), it looks for one as ai_spaceship_move. Returns
+ * false if there is no enemy to attack or the id is AI_NO_TARGET.
+ * With map->splash, attacks whose blast would hit several enemies and no
+ * friend are SPLASH moves, here and in ai_spaceship_move. */
+bool ai_spaceship_attack(map_t* map,
+                         spaceship_t spaceship,
+                         int target_team,
+                         int target_id,
+                         move_t* move,
+                         unsigned int* seed);
+
+/* Fills move with the decision of spaceship for a command of the given type.
+ * Returns false if the command cannot be done (no enemy to attack). With
+ * map->continuous a MOVE is sent as the THRUST towards the square chosen. */
+bool ai_spaceship_move(map_t* map,
+                       spaceship_t spaceship,
+                       int type,
+                       move_t* move,
+                       unsigned int* seed);
+
+#endif /* SRC_AI_H_ */
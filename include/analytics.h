@@ -0,0 +1,104 @@
+#ifndef SRC_ANALYTICS_H_
+#define SRC_ANALYTICS_H_
+
+#include <stdint.h> // int32_t, uint32_t
+#include <time.h>   // struct timespec
+
+#include <game.h>      // outcome_t, blasts_t
+#include <simulator.h> // map_t, move_t, spaceship_t
+
+#define ANALYTICS_MAGIC 0x414c5453 // "STLA"
+#define ANALYTICS_VERSION 1
+#define ANALYTICS_NAME_SIZE 16 // Chars of table and column names, with '\0'
+#define ANALYTICS_MAX_COLUMNS 16
+#define ANALYTICS_N_TABLES 2
+
+/*** COLUMNS OF THE TABLE "turns", ONE ROW PER TURN ***/
+enum {
+    TURN_COL_TURN,
+    TURN_COL_MOVES,        // Moves received
+    TURN_COL_INVALID,      // Outcomes of those moves
+    TURN_COL_BLOCKED,
+    TURN_COL_MOVED,
+    TURN_COL_MISSED,
+    TURN_COL_DAMAGED,
+    TURN_COL_DESTROYED,
+    TURN_COL_RESOLVE_USEC, // Time spent applying the moves
+    TURN_COL_TURN_USEC,    // Wall time of the turn
+    N_TURN_COLUMNS
+};
+
+/*** COLUMNS OF THE TABLE "teams", ONE ROW PER TEAM AND TURN ***/
+enum {
+    TEAM_COL_TURN,
+    TEAM_COL_TEAM,
+    TEAM_COL_MOVED,        // Moves done
+    TEAM_COL_DISTANCE,     // Squares travelled by those moves
+    TEAM_COL_ATTACKS,      // Attacks to a square, including the missed ones
+    TEAM_COL_HITS,         // Attacks that damaged or destroyed a spaceship
+    TEAM_COL_DAMAGE_DEALT,
+    TEAM_COL_DAMAGE_TAKEN,
+    TEAM_COL_KILLS,        // Enemy spaceships destroyed
+    TEAM_COL_LOSSES,       // Own spaceships destroyed
+    TEAM_COL_ALIVE,        // Spaceships alive at the end of the turn
+    TEAM_COL_HEALTH,       // Their total health
+    N_TEAM_COLUMNS
+};
+
+/* A table kept by columns: column c of row r is data[c][r]. */
+typedef struct {
+    char name[ANALYTICS_NAME_SIZE];
+    uint32_t n_columns;
+    char columns[ANALYTICS_MAX_COLUMNS][ANALYTICS_NAME_SIZE];
+    int32_t* data[ANALYTICS_MAX_COLUMNS];
+    uint32_t n_rows;
+    uint32_t capacity;
+} analytics_table_t;
+
+/* Layout of an analytics file:
+ *   uint32_t magic, version, number of tables
+ *   for every table:
+ *     name, uint32_t n_columns, uint32_t n_rows, n_columns names
+ *     n_columns arrays of n_rows int32_t
+ * Names take ANALYTICS_NAME_SIZE bytes. A column can be read without
+ * touching the others. */
+typedef struct {
+    analytics_table_t tables[ANALYTICS_N_TABLES]; // "turns" and "teams"
+    int32_t turn_row[N_TURN_COLUMNS];             // Current turn
+    int32_t team_rows[N_TEAMS][N_TEAM_COLUMNS];   // Current turn by team
+    struct timespec turn_start;
+} analytics_t;
+
+void analytics_init(analytics_t* analytics);
+
+void analytics_free(analytics_t* analytics);
+
+void analytics_begin_turn(analytics_t* analytics);
+
+/* Accounts a move and its outcome. target is the attacked spaceship after
+ * the attack and usec the time it took to apply the move. */
+void analytics_add_move(analytics_t* analytics,
+                        move_t move,
+                        outcome_t outcome,
+                        spaceship_t* target,
+                        long usec);
+
+/* Accounts the SPLASH of the turn: blasts as they were fired and the victims
+ * returned by game_resolve_blasts. Each blast that hit someone is a hit of
+ * its team, and each victim in its range takes SPLASH_DAMAGE from it. A
+ * spaceship destroyed is a kill of the first enemy blast in range. */
+void analytics_add_blasts(analytics_t* analytics,
+                          blasts_t* blasts,
+                          spaceship_t* victims,
+                          int n_victims);
+
+/* Appends the rows of the turn, with the state of map at its end. The rows
+ * grow in memory: nothing is written until analytics_write. */
+status analytics_end_turn(analytics_t* analytics, map_t* map, int turn);
+
+status analytics_write(analytics_t* analytics, const char* path);
+
+/* Reads a file written by analytics_write. */
+status analytics_load(analytics_t* analytics, const char* path);
+
+#endif /* SRC_ANALYTICS_H_ */
@@ -0,0 +1,16 @@
+#ifndef SRC_FLOWFIELD_H_
+#define SRC_FLOWFIELD_H_
+
+#include <simulator.h> // map_t
+
+/* Recomputes the flow field of every team: the number of moves from each
+ * square to the nearest enemy spaceship the team can see, going only through
+ * empty squares.
+ * Occupied squares get a distance but are not crossed. */
+void flowfield_update(map_t* map);
+
+/* Distance from the square to the nearest enemy of team, FLOW_UNREACHABLE if
+ * there is no path or no enemy in sight. */
+int flowfield_get(map_t* map, int team, int posy, int posx);
+
+#endif /* SRC_FLOWFIELD_H_ */
@@ -0,0 +1,40 @@
+#ifndef SRC_FRAME_H_
+#define SRC_FRAME_H_
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
+
+#include <simulator.h> // map_t, spaceship_t
+
+/*** FRAME TYPES ***/
+#define FRAME_KEY 'K'   // Full state of every spaceship and the terrain
+#define FRAME_DELTA 'D' // Only the spaceships that changed since last frame
+
+#define FRAME_MAX_VARINT 5 // Max bytes of an encoded 32 bits integer
+// Upper bound of the payload of any frame
+#define FRAME_MAX_SIZE                                                       \
+    (FRAME_MAX_VARINT + N_TEAMS * N_SPACESHIPS * (1 + 4 * FRAME_MAX_VARINT) + \
+     FRAME_MAX_VARINT * (1 + MAP_MAX_X * MAP_MAX_Y))
+
+/* Encodes the state of every spaceship and the squares with an asteroid in
+ * buf. terrain may be NULL if there are none. Returns the bytes written. */
+size_t frame_encode_key(spaceship_t cur[N_TEAMS][N_SPACESHIPS],
+                        uint64_t terrain[MAP_VISIBLE_WORDS],
+                        unsigned char* buf);
+
+/* Encodes the spaceships of cur that differ from prev in buf. Returns the
+ * bytes written. */
+size_t frame_encode_delta(spaceship_t prev[N_TEAMS][N_SPACESHIPS],
+                          spaceship_t cur[N_TEAMS][N_SPACESHIPS],
+                          unsigned char* buf);
+
+/* Applies a frame of the given type to map, rebuilding squares and counters.
+ * Returns ERROR if the frame is malformed or puts a spaceship out of the
+ * map. */
+status frame_apply(map_t* map, int type, unsigned char* buf, size_t len);
+
+size_t frame_put_varint(unsigned char* buf, unsigned int value);
+
+size_t frame_get_varint(unsigned char* buf, size_t len, unsigned int* value);
+
+#endif /* SRC_FRAME_H_ */
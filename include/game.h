@@ -0,0 +1,60 @@
+#ifndef SRC_GAME_H_
+#define SRC_GAME_H_
+
+#include <scenario.h>  // scenario_t
+#include <simulator.h> // map_t, move_t, spaceship_t
+
+/*** OUTCOMES OF A MOVE ***/
+typedef enum {
+    OUTCOME_INVALID,   // The spaceship is dead or the move is malformed
+    OUTCOME_BLOCKED,   // MOVE to a square that is not empty
+    OUTCOME_MOVED,     // MOVE done
+    OUTCOME_MISSED,    // ATTACK to an empty square
+    OUTCOME_DAMAGED,   // ATTACK that left the target alive
+    OUTCOME_DESTROYED, // ATTACK that destroyed the target
+    OUTCOME_LAUNCHED,  // SPLASH on its way, it hits at the end of the turn
+    OUTCOME_THRUST     // THRUST kept, the spaceship moves at the end of the
+                       // turn
+} outcome_t;
+
+#define GAME_MAX_BLASTS (N_TEAMS * N_SPACESHIPS * N_ACTIONS_LEADER)
+
+/* SPLASH impacts of a turn, resolved together. */
+typedef struct {
+    int n;
+    int posy[GAME_MAX_BLASTS];
+    int posx[GAME_MAX_BLASTS];
+    int team[GAME_MAX_BLASTS]; // Team that fired each one
+} blasts_t;
+
+/* Cleans the map, lays the asteroids of scenario and places the spaceships in
+ * their formations, the rest in random empty squares. Without a scenario the
+ * whole map is open and every spaceship is placed at random. */
+void game_init_map(map_t* map, scenario_t* scenario, unsigned int* seed);
+
+/* Applies the rules of the game to a move. If the move is an attack that hit
+ * a spaceship, target holds its state after the attack. A SPLASH only
+ * checks that the spaceship can fire and that map->splash is on, the caller
+ * adds it to the blasts. With map->continuous a MOVE is invalid: spaceships
+ * only move by THRUST. */
+outcome_t game_process_move(map_t* map, move_t move, spaceship_t* target);
+
+/* Adds the impact of a launched SPLASH to the blasts of the turn. */
+void game_add_blast(blasts_t* blasts, move_t move);
+
+/* Damages every spaceship at most SPLASH_RADIUS squares from the impact of
+ * a blast, SPLASH_DAMAGE per blast. Blasts are added to a difference array
+ * and one prefix sum over the squares they cover gives the damage of each
+ * square, so the cost does not grow with the radius. Blasts with nobody in
+ * range are skipped with the occupancy sums. Fills victims with the
+ * spaceships hit, after the damage, and returns how many. Empties blasts.
+ * The occupancy sums are left as they were before the blasts. */
+int game_resolve_blasts(map_t* map,
+                        blasts_t* blasts,
+                        spaceship_t victims[N_TEAMS * N_SPACESHIPS]);
+
+/* Returns the only team with spaceships alive, -1 if there are several and
+ * N_TEAMS if there is none. */
+int game_get_winner(map_t* map);
+
+#endif /* SRC_GAME_H_ */
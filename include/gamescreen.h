@@ -10,6 +10,20 @@ void screen_init();
  * screen_refresh() */
 void screen_addch(int row, int col, char symbol);
 
+/* Escribe una cadena desde la posición fila, columna. Como screen_addch, no
+ * se muestra hasta el próximo screen_refresh() */
+void screen_addstr(int row, int col, const char* str);
+
+/* Borra todo lo que hay en pantalla */
+void screen_clear();
+
+/* Devuelve el número de filas y columnas del terminal */
+void screen_size(int* rows, int* cols);
+
+/* Devuelve la siguiente tecla pulsada sin esperar, o -1 si no hay ninguna.
+ * Las flechas se devuelven como 'h', 'j', 'k' y 'l' */
+int screen_getch();
+
 /* Refresca lo que muestra la pantalla. En principio, no hay que hacer refresh
  * cada vez que se añade un símbolo con screen_addch()*/
 void screen_refresh();
@@ -0,0 +1,39 @@
+#ifndef SRC_IPC_H_
+#define SRC_IPC_H_
+
+#include <simulator.h> // status
+
+#define IPC_MAX_INSTANCE 32 // Max chars of an instance id
+#define IPC_MAX_NAME (16 + IPC_MAX_INSTANCE)
+
+/* Names of the shared resources of a simulator instance. The default
+ * instance uses the names of simulator.h, any other one appends ".<id>" to
+ * them, so several simulators can run in the same host. */
+typedef struct {
+    char instance[IPC_MAX_INSTANCE + 1]; // Empty for the default instance
+    char shm_map[IPC_MAX_NAME];
+    char shm_rewind[IPC_MAX_NAME];
+    char shm_snapshot[IPC_MAX_NAME];
+    char mq_actions[N_TEAMS][IPC_MAX_NAME]; // One queue per team
+    char sem_count_r[IPC_MAX_NAME];
+    char sem_mutex[IPC_MAX_NAME];
+    char sem_w[IPC_MAX_NAME];
+    char sem_r[IPC_MAX_NAME];
+    char sem_ready[IPC_MAX_NAME];
+} ipc_names_t;
+
+/* Builds the names of instance, which may be NULL or empty for the default
+ * one. Returns ERROR if the id is too long or has characters other than
+ * letters, digits, '-' and '_'. */
+status ipc_names_init(ipc_names_t* names, const char* instance);
+
+/* Removes the resources left by a simulator of the instance that died
+ * without cleaning up. Returns ERROR if the simulator that owns them is
+ * still running. */
+status ipc_reclaim(ipc_names_t* names);
+
+/* Removes the message queues, the semaphores, the rewind buffer and the
+ * snapshot of the instance. The map is removed with shm_region_destroy. */
+void ipc_unlink(ipc_names_t* names);
+
+#endif /* SRC_IPC_H_ */
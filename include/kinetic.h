@@ -0,0 +1,20 @@
+#ifndef SRC_KINETIC_H_
+#define SRC_KINETIC_H_
+
+#include <simulator.h> // map_t, move_t, spaceship_t
+
+/* Puts every spaceship still in the center of its square. */
+void kinetic_init(map_t* map);
+
+/* Keeps the thrust of a THRUST for the rest of the turn, each axis limited
+ * to KINETIC_MAX_THRUST. */
+void kinetic_thrust(map_t* map, move_t move);
+
+/* Advances the spaceships alive one turn and moves them to the squares of
+ * their new positions. The map is the broadphase: a spaceship only enters
+ * an empty square, else it slides along the free axis or stops, so no two
+ * spaceships ever share a square. Thrust is spent. Returns the spaceships
+ * that changed square. */
+int kinetic_advance(map_t* map);
+
+#endif /* SRC_KINETIC_H_ */
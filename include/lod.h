@@ -0,0 +1,46 @@
+#ifndef SRC_LOD_H_
+#define SRC_LOD_H_
+
+#include <simulator.h> // map_t, spaceship_t, status
+
+#define LOD_MAX_LEVELS 16
+
+/*** SYMBOLS OF A BLOCK ***/
+#define LOD_SYMB_TIE '#'   // Several teams with the same number of spaceships
+#define LOD_SYMB_FIGHT '%' // Damaged spaceships of several teams
+
+/* Spaceships alive in a block of squares. */
+typedef struct {
+    unsigned short count[N_TEAMS];   // Spaceships of each team
+    unsigned short damaged[N_TEAMS]; // Those of them that lost some health
+} lod_cell_t;
+
+/* Mip pyramid of the spaceships: a cell of level l sums a block of
+ * 2^l x 2^l squares, so level 0 is the map and the last level has a single
+ * cell. It is updated from the spaceships that changed since the last
+ * update, touching one cell per level for each of them. */
+typedef struct {
+    int n_levels;
+    int width[LOD_MAX_LEVELS];     // Cells in a row of each level
+    int height[LOD_MAX_LEVELS];    // Cells in a column of each level
+    lod_cell_t* cells[LOD_MAX_LEVELS];
+    spaceship_t last[N_TEAMS][N_SPACESHIPS]; // State already in the pyramid
+} lod_t;
+
+status lod_init(lod_t* lod);
+
+void lod_free(lod_t* lod);
+
+/* Brings the pyramid to the spaceships of map. */
+void lod_update(lod_t* lod, map_t* map);
+
+/* Cell (row, col) of level. Coordinates are in cells of that level. */
+lod_cell_t lod_get(lod_t* lod, int level, int row, int col);
+
+/* Character that summarises a cell: SYMB_EMPTY without spaceships,
+ * LOD_SYMB_FIGHT if several teams have damaged spaceships in it, LOD_SYMB_TIE
+ * if no team has more spaceships than the others, or the symbol of the
+ * dominant team, in lowercase if it only has one spaceship in the block. */
+char lod_symbol(lod_cell_t cell);
+
+#endif /* SRC_LOD_H_ */
@@ -2,9 +2,18 @@
 #define SRC_map_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <simulator.h> // spaceship_t
 
+/* Playable areas, as rows and columns, whose kernels are built with
+ * constant bounds. The first one is the whole map. A build adds more with
+ * MAP_EXTRA_GEOMETRIES(X), a list such as X(16, 16) X(18, 20). */
+#ifndef MAP_EXTRA_GEOMETRIES
+#define MAP_EXTRA_GEOMETRIES(X)
+#endif
+#define MAP_GEOMETRIES(X) X(MAP_MAX_Y, MAP_MAX_X) MAP_EXTRA_GEOMETRIES(X)
+
 square_t map_get_square(map_t* map, int posy, int posx);
 
 int map_get_distance(map_t* map, int oriy, int orix, int targety, int targetx);
@@ -13,14 +22,51 @@ spaceship_t map_get_spaceship(map_t* map, int team, int id_spaceship);
 
 int map_get_num_spaceships(map_t* map, int team);
 
+/* Number of enemy spaceships of team that can attack the square. */
+int map_get_threat(map_t* map, int team, int posy, int posx);
+
+/* Health of the spaceships of team that can attack the square minus the
+ * health of the enemy ones. */
+int map_get_influence(map_t* map, int team, int posy, int posx);
+
+/* Rebuilds the occupancy prefix sums from the spaceships alive. */
+void map_update_occupancy(map_t* map);
+
+/* Spaceships of team at most radius squares away from the square, as of the
+ * last map_update_occupancy. Four reads whatever the radius. */
+int map_count_spaceships(map_t* map, int team, int posy, int posx, int radius);
+
+/* Hash of the whole state computed from scratch. map->hash must always be
+ * equal to it; it is kept up to date by map_set_spaceship and
+ * map_clean_square. */
+uint64_t map_compute_hash(map_t* map);
+
+/* True if any spaceship of team is at most sensor_range squares away. */
+bool map_is_visible(map_t* map, int team, int posy, int posx);
+
+/* The square as team sees it: empty if it is not visible. Asteroids are
+ * always visible. */
+square_t map_get_view(map_t* map, int team, int posy, int posx);
+
+/* Changes the sensor range and recomputes the visibility of every team. */
+void map_set_sensor_range(map_t* map, int range);
+
 char map_get_symbol(map_t* map, int posy, int posx);
 
 bool map_is_square_empty(map_t* map, int posy, int posx);
 
 bool square_is_empty(map_t* map, square_t square);
 
+/* Empties the square, asteroid included. */
 void map_clean_square(map_t* map, int posy, int posx);
 
+/* Puts an asteroid in an empty square. Nothing can move into it and attacks
+ * against it miss. */
+void map_set_asteroid(map_t* map, int posy, int posx);
+
+bool map_is_asteroid(map_t* map, int posy, int posx);
+
+/* Restores the symbols of the squares of the playable area. */
 void map_restore(map_t* map);
 
 void map_send_missil(map_t* map,
@@ -31,6 +77,12 @@ void map_send_missil(map_t* map,
 
 int map_set_spaceship(map_t* map, spaceship_t spaceship);
 
+/* Chooses the kernels of map_restore, map_send_missil and map_compute_hash
+ * for a playable area in the top left corner, whose outside is asteroids.
+ * It holds for every map of this process. Returns true if the kernels of
+ * one of MAP_GEOMETRIES are used, false for the generic ones. */
+bool map_set_area(int height, int width);
+
 void map_set_num_spaceships(map_t* map, int team, int numspaceships);
 
 void map_set_symbol(map_t* map, int posy, int posx, char symbol);
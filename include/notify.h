@@ -0,0 +1,31 @@
+#ifndef SRC_NOTIFY_H_
+#define SRC_NOTIFY_H_
+
+#include <pthread.h> // pthread_t
+
+#include <simulator.h> // map_t, status
+
+/* Wakes the readers of the map when the simulator commits a change. The
+ * counter map->commits is a futex, and a thread of the reader turns each
+ * wake up into an event of an eventfd, so it can be polled together with
+ * the terminal or the sockets. Nothing runs while the map does not change. */
+typedef struct {
+    int fd;           // eventfd, readable after a commit
+    map_t* map;
+    pthread_t thread; // Waits on the futex
+    volatile int stop;
+} notify_t;
+
+/* Publishes a change of map and wakes every reader. */
+void notify_commit(map_t* map);
+
+/* Starts waiting for the commits to map, which may be mapped read only. */
+status notify_open(notify_t* notify, map_t* map);
+
+/* Empties the eventfd after it was readable. Returns the commits seen since
+ * the last call, or 0 if there was none. */
+unsigned long notify_clear(notify_t* notify);
+
+void notify_close(notify_t* notify);
+
+#endif /* SRC_NOTIFY_H_ */
@@ -0,0 +1,38 @@
+#ifndef SRC_OBSERVER_H_
+#define SRC_OBSERVER_H_
+
+#include <stdint.h> // uint32_t
+
+#include <frame.h> // FRAME_*
+
+#define OBSERVER_SOCKET "/tmp/stellar_observer.sock"
+#define OBSERVER_SOCKET_INSTANCE "/tmp/stellar_observer.%s.sock" // Instance %s
+#define OBSERVER_MAX_CLIENTS 64
+#define OBSERVER_MAX_STALLS 8 // Turns a client can stay behind before dropping
+#define OBSERVER_FLUSH_MSEC 1000 // Time given to the clients at the end
+#define OBSERVER_HIDDEN -1 // Health of the spaceships out of the region
+
+/* Sent by a client at any time to choose the squares it is interested in.
+ * The region is inclusive. A negative x1 or y1 means the whole map. Every
+ * subscription is answered with a FRAME_KEY of the region. */
+typedef struct {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+} observer_roi_t;
+
+/* Every message of the observer is this header followed by len bytes of a
+ * frame (see frame.h). Keyframes only carry the asteroids of the region.
+ * Spaceships out of it are hidden: not alive, at 0,0 and with a health of
+ * OBSERVER_HIDDEN, which no destroyed spaceship has. They cost nothing in
+ * the deltas while they stay out. */
+typedef struct {
+    uint32_t type; // FRAME_KEY or FRAME_DELTA
+    uint32_t turn;
+    uint32_t len;
+} observer_msg_t;
+
+#define OBSERVER_MSG_MAX_SIZE (sizeof(observer_msg_t) + FRAME_MAX_SIZE)
+
+#endif /* SRC_OBSERVER_H_ */
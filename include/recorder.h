@@ -0,0 +1,68 @@
+#ifndef SRC_RECORDER_H_
+#define SRC_RECORDER_H_
+
+#include <stdint.h> // uint32_t, uint64_t
+#include <stdio.h>  // FILE
+
+#include <simulator.h> // map_t, spaceship_t
+
+#define RECORD_MAGIC 0x524c5453 // "STLR"
+#define RECORD_VERSION 2
+#define RECORD_KEYFRAME_INTERVAL 16 // Default turns between keyframes
+#define RECORD_INDEX_SUFFIX ".idx"
+
+/* Layout of a recording:
+ *   <path>      record_header_t, then one frame per turn:
+ *               [type][turn varint][payload length varint][hash][payload]
+ *   <path>.idx  record_header_t, then the uint64_t offset of every keyframe.
+ * Keyframe k holds turn k * keyframe_interval, so any turn is reached by
+ * reading one index entry, one keyframe and less than keyframe_interval
+ * deltas. hash is the uint64_t map->hash after the turn, so a replay can
+ * tell the first turn where it diverged from the recorded run. */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t map_max_x;
+    uint32_t map_max_y;
+    uint32_t n_teams;
+    uint32_t n_spaceships;
+    uint32_t keyframe_interval;
+} record_header_t;
+
+typedef struct {
+    FILE* data;
+    FILE* index;
+    int keyframe_interval;
+    spaceship_t last[N_TEAMS][N_SPACESHIPS]; // State of the last frame
+} recorder_t;
+
+typedef struct {
+    FILE* data;
+    FILE* index;
+    record_header_t header;
+    int turn;          // Turn currently held in map, -1 if none
+    int n_keyframes;   // Entries in the index
+    uint64_t hash;     // Recorded hash of turn
+    int diverged;      // First turn whose hash did not match, -1 if none
+} replay_t;
+
+status recorder_open(recorder_t* rec, const char* path, int keyframe_interval);
+
+/* Appends the state of map at the end of turn. Turns must be consecutive and
+ * start at 0. */
+status recorder_write_turn(recorder_t* rec, map_t* map, int turn);
+
+void recorder_close(recorder_t* rec);
+
+status replay_open(replay_t* rep, const char* path);
+
+/* Leaves in map the state at the end of turn. Returns ERROR if the turn was
+ * not recorded. */
+status replay_seek(replay_t* rep, map_t* map, int turn);
+
+/* Advances map one turn. Returns ERROR at the end of the recording. */
+status replay_next(replay_t* rep, map_t* map);
+
+void replay_close(replay_t* rep);
+
+#endif /* SRC_RECORDER_H_ */
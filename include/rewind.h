@@ -0,0 +1,54 @@
+#ifndef SRC_REWIND_H_
+#define SRC_REWIND_H_
+
+#include <stdbool.h> // bool
+
+#include <simulator.h> // map_t
+
+#define REWIND_SLOTS 16 // Turns kept at most
+#define REWIND_PAGE_SIZE 4096
+#define REWIND_MAP_PAGES                                                     \
+    ((sizeof(map_t) + REWIND_PAGE_SIZE - 1) / REWIND_PAGE_SIZE)
+// Pages shared by every snapshot, enough for all of them with every page
+// written. Shared memory is only backed once touched and freed pages are
+// reused first, so what is resident follows the pages written.
+#define REWIND_POOL_PAGES (REWIND_SLOTS * REWIND_MAP_PAGES)
+
+typedef struct {
+    unsigned int seq;            // Odd while the slot is written or dropped
+    int turn;                    // -1 if the slot is empty
+    int pages[REWIND_MAP_PAGES]; // Page of the pool of each page of the map
+} rewind_slot_t;
+
+/* Ring of the maps of the last turns, in shared memory. Each snapshot is a
+ * table of pages, and the pages that did not change since the previous turn
+ * are shared with it, so the memory used grows with the pages written and
+ * not with the turns. Only the simulator writes it. */
+typedef struct {
+    int head;                        // Slot of the newest snapshot
+    int count;                       // Snapshots kept
+    long pages_copied;               // Pages written by every push
+    long pages_shared;               // Pages taken from the previous snapshot
+    rewind_slot_t slots[REWIND_SLOTS];
+    int refcount[REWIND_POOL_PAGES]; // Snapshots using each page
+    int free_pages[REWIND_POOL_PAGES];
+    int n_free;
+    unsigned char pool[REWIND_POOL_PAGES][REWIND_PAGE_SIZE]
+      __attribute__((aligned(REWIND_PAGE_SIZE)));
+} rewind_t;
+
+void rewind_init(rewind_t* rewind);
+
+/* Takes a snapshot of map at the end of a turn, dropping the oldest ones if
+ * there is no room. Must not run at the same time as the writes to map. */
+void rewind_push(rewind_t* rewind, map_t* map);
+
+/* Copies the snapshot of a turn into map. Returns false if the turn is not
+ * kept or it was dropped while being copied. Safe while the simulator
+ * pushes. */
+bool rewind_read(rewind_t* rewind, int turn, map_t* map);
+
+/* Oldest and newest turns kept. Returns false if there is none. */
+bool rewind_range(rewind_t* rewind, int* oldest, int* newest);
+
+#endif /* SRC_REWIND_H_ */
@@ -0,0 +1,42 @@
+#ifndef SRC_SCENARIO_H_
+#define SRC_SCENARIO_H_
+
+#include <stdint.h> // uint64_t
+
+#include <simulator.h> // MAP_*, N_TEAMS, status
+
+#define SCENARIO_MAX_LINE 128
+
+/*** STARTING FORMATIONS ***/
+typedef enum {
+    FORMATION_RANDOM, // Any free square of the map
+    FORMATION_LINE,   // A row centered in the anchor
+    FORMATION_COLUMN, // A column centered in the anchor
+    FORMATION_BLOCK,  // A square centered in the anchor
+    FORMATION_WEDGE,  // A V with the first spaceship in the anchor
+    N_FORMATIONS
+} formation_t;
+
+/* A scenario file is a list of lines, '#' starts a comment:
+ *
+ *   size <rows> <columns>                 playable area, at most the map
+ *   asteroid <row> <column> [rows cols]   a square or a rectangle
+ *   team <symbol> <formation> [row col]   formation and anchor of a team
+ *
+ * The squares of the map out of the playable area are asteroids. */
+typedef struct {
+    int height;
+    int width;
+    uint64_t asteroids[MAP_VISIBLE_WORDS]; // Row major bits, as map terrain
+    formation_t formation[N_TEAMS];
+    int posy[N_TEAMS]; // Anchor of the formation
+    int posx[N_TEAMS];
+} scenario_t;
+
+/* Reads a scenario from a file, mapped instead of read. The errors are
+ * printed with their line. Fails if the spaceships do not fit. */
+status scenario_load(scenario_t* scenario, const char* path);
+
+const char* scenario_formation_name(formation_t formation);
+
+#endif /* SRC_SCENARIO_H_ */
@@ -0,0 +1,54 @@
+#ifndef SRC_SHM_H_
+#define SRC_SHM_H_
+
+#include <stddef.h> // size_t
+
+#include <simulator.h> // status
+
+#define SHM_HUGE_PATH "/dev/hugepages" // Mount point of hugetlbfs
+#define SHM_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/*** ALLOCATION FLAGS ***/
+#define SHM_HUGE 0x1       // Try 2 MB pages, fall back to normal ones
+#define SHM_PREFAULT 0x2   // Fault every page in at setup
+#define SHM_INTERLEAVE 0x4 // Interleave the pages across NUMA nodes
+
+/*** BACKENDS ***/
+#define SHM_BACKEND_POSIX 0     // shm_open in /dev/shm
+#define SHM_BACKEND_HUGETLBFS 1 // File in SHM_HUGE_PATH
+
+typedef struct {
+    int fd;
+    void* addr;
+    size_t size;     // Bytes mapped, rounded up to the page size in use
+    int backend;     // SHM_BACKEND_*
+    int numa_nodes;  // Nodes the pages are interleaved across, 0 if none
+    long minflt;     // Minor page faults during the setup
+    long majflt;     // Major page faults during the setup
+    long setup_usec; // Time spent in the setup
+} shm_region_t;
+
+/* Creates and maps read/write a new shared region of size bytes. The name
+ * follows the shm_open rules. */
+status shm_region_create(shm_region_t* region,
+                         const char* name,
+                         size_t size,
+                         int flags);
+
+/* Maps a region created by another process with the given protection.
+ * Only SHM_PREFAULT is meaningful in flags. */
+status shm_region_attach(shm_region_t* region,
+                         const char* name,
+                         size_t size,
+                         int prot,
+                         int flags);
+
+void shm_region_detach(shm_region_t* region);
+
+/* Detaches and removes the region whatever the backend. */
+void shm_region_destroy(shm_region_t* region, const char* name);
+
+/* Prints the backend, page faults and setup time of the region. */
+void shm_region_report(shm_region_t* region, const char* who);
+
+#endif /* SRC_SHM_H_ */
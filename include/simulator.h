@@ -1,7 +1,9 @@
 #ifndef SRC_SIMULADOR_H_
 #define SRC_SIMULADOR_H_
 
-#include <stdbool.h> // bool
+#include <stdbool.h>   // bool
+#include <stdint.h>    // uint64_t
+#include <sys/types.h> // pid_t
 
 #define N_TEAMS 3
 #define N_SPACESHIPS 3
@@ -11,6 +13,9 @@
 #define MAX_ATACK_SCOPE 20
 #define ATACK_DAMAGE 10
 #define MOVE_RANGE 1
+#define SPLASH_RADIUS 1 // Squares around the impact hit
+#define SPLASH_DAMAGE (ATACK_DAMAGE / 2) // To every spaceship hit
+#define SENSOR_RANGE MAX_ATACK_SCOPE // Default squares seen around a spaceship
 #define TURN_DURATION 5
 
 /*** COMMANDS ***/
@@ -22,18 +27,53 @@
 /*** MOVES ***/
 #define MOVE 0
 #define ATTACK 1
+#define SPLASH 5 // Damages every spaceship around the impact at turn end
+#define THRUST 6 // Accelerates a spaceship, with continuous movement
 
 /*** MAP ***/
+#ifndef MAP_MAX_X
 #define MAP_MAX_X 20 // Number of columns of the map
+#endif
+#ifndef MAP_MAX_Y
 #define MAP_MAX_Y 20 // Number of rows of the map
+#endif
 #define SYMB_EMPTY '.'
 #define SYMB_DAMAGED '%'
 #define SYMB_DESTROYED 'X'
 #define SYMB_WATER 'w'
+#define SYMB_ASTEROID '#'
+#define TEAM_ASTEROID -2 // team of a square with an asteroid
+#define FLOW_UNREACHABLE 0xffff // Flow field value without path to an enemy
+#define MAP_VISIBLE_WORDS ((MAP_MAX_X * MAP_MAX_Y + 63) / 64)
+
+/*** SPARSE MAP ***/
+// Built with -DMAP_SPARSE the squares are kept in chunks that only exist
+// while some of their squares is not empty
+#define MAP_CHUNK_SHIFT 6 // Chunks of 64x64 squares
+#define MAP_CHUNK_SIZE (1 << MAP_CHUNK_SHIFT)
+#define MAP_CHUNKS_Y ((MAP_MAX_Y + MAP_CHUNK_SIZE - 1) >> MAP_CHUNK_SHIFT)
+#define MAP_CHUNKS_X ((MAP_MAX_X + MAP_CHUNK_SIZE - 1) >> MAP_CHUNK_SHIFT)
+#ifndef MAP_SPARSE_CHUNKS
+#define MAP_SPARSE_CHUNKS (MAP_CHUNKS_Y * MAP_CHUNKS_X) // Chunks of the pool
+#endif
+
+/*** CONTINUOUS MOVEMENT ***/
+// Positions in squares and velocities in squares per turn, integrated in
+// KINETIC_STEPS steps at the end of each turn
+#define KINETIC_STEPS 8
+#define KINETIC_MAX_SPEED (MOVE_RANGE * N_ACTIONS_LEADER) // On each axis
+#define KINETIC_MAX_THRUST (2 * KINETIC_MAX_SPEED)
+#define KINETIC_LANES 4 // Floats of a SIMD register, arrays are padded
+#define KINETIC_N                                                            \
+    ((N_TEAMS * N_SPACESHIPS + KINETIC_LANES - 1) / KINETIC_LANES *          \
+     KINETIC_LANES)
 
 /*** NAMES OF SHARED RESOURCES ***/
+// Names of the default instance, see ipc.h for the others
 #define SHM_MAP_NAME "/shm_map"
-#define MQ_ACTION_NAME "/mq_actions"
+#define SHM_REWIND_NAME "/shm_rewind"
+#define SHM_SNAPSHOT_NAME "/shm_snapshot"
+#define MQ_ACTION_NAME "/mq_actions" // Followed by "_<team>"
 #define SEM_COUNT_R_NAME "/sem_count_r"
 #define SEM_MUTEX_R_NAME "/sem_mutex"
 #define SEM_W_NAME "/sem_w"
@@ -43,6 +83,13 @@
 #define N_ACTIONS_LEADER 2 // Number of leader actions in each turn
 #define MAX_CHAR_ID 12     // Max chars for an identification integer
 
+/*** ADMISSION OF MOVES ***/
+#define MQ_TEAM_DEPTH (2 * N_SPACESHIPS) // Moves a team queue can hold
+#define DRR_QUANTUM 2                    // Cost a team can spend in a round
+#define DRR_COST_MOVE 1
+#define DRR_COST_ATTACK 2 // The missile animation makes it twice as slow
+#define DRR_COST_SPLASH DRR_COST_ATTACK
+
 typedef struct {
     int health; // Remaining health
     int posx;   // map column
@@ -54,15 +101,92 @@ typedef struct {
 
 typedef struct {
     char symbol;      // Symbol shown in the screen
-    int team;         // Team that is in the square. If there is no team is -1.
+    int team;         // Team that is in the square. If there is no team is -1,
+                      // TEAM_ASTEROID if nobody can be there.
     int id_spaceship; // Ship that is in the square.
 } square_t;
 
+#ifdef MAP_SPARSE
+typedef struct {
+    int used; // Squares with a team or a symbol other than SYMB_EMPTY
+    int next; // Next free chunk of the pool plus one, 0 for the last one
+    square_t squares[MAP_CHUNK_SIZE][MAP_CHUNK_SIZE];
+} map_chunk_t;
+#endif
+
+/* Continuous state of the spaceships as a structure of arrays, so one loop
+ * advances all of them a lane each. Spaceship id of team is at
+ * team * N_SPACESHIPS + id. */
+typedef struct {
+    float posx[KINETIC_N];
+    float posy[KINETIC_N];
+    float velx[KINETIC_N];
+    float vely[KINETIC_N];
+    float accx[KINETIC_N]; // Thrust of the turn
+    float accy[KINETIC_N];
+} kinetic_t;
+
+/* Admission of the moves of a team since the start of the match. */
+typedef struct {
+    int accepted;  // Processed by the simulator
+    int dropped;   // Over the budget of the spaceship or too old
+    int deferred;  // Still queued at the end of a turn, left for the next
+    int coalesced; // Not sent because the queue was full, replaced by the
+                   // next move of the same spaceship
+} admission_t;
+
 typedef struct {
     spaceship_t spaceships[N_TEAMS]
                           [N_SPACESHIPS]; // Info about spaceships in the map
+#ifdef MAP_SPARSE
+    // Chunk of the pool of each block of squares plus one, 0 if it is empty
+    int chunk_dir[MAP_CHUNKS_Y][MAP_CHUNKS_X];
+    int chunks_used;  // Chunks holding squares
+    int chunks_taken; // Chunks of the pool ever used, the rest are untouched
+    int chunks_free;  // First free chunk plus one, 0 if none
+    int chunks_full;  // Squares not written because the pool was full
+#else
     square_t squares[MAP_MAX_Y][MAP_MAX_X];
+#endif
     int n_spaceships_alive[N_TEAMS]; // Number of spaceships alive in each team
+    pid_t owner;                     // Simulator that created the map
+    int monitor_cpu;                 // Reserved for the monitor, -1 if none
+    int height;                      // Rows of the playable area
+    int width;                       // Columns, the rest are asteroids
+    bool pipelined;                  // Agents decide on the last snapshot
+    bool splash;                     // Spaceships may fire SPLASH
+    bool continuous;                 // Spaceships move with THRUST
+    int turn;                        // Last turn completed by the simulator
+    uint64_t hash;      // Zobrist hash of the spaceships and their squares
+    uint64_t turn_hash; // hash at the end of the last completed turn
+    unsigned short flow[N_TEAMS][MAP_MAX_Y]
+                       [MAP_MAX_X]; // Moves to the nearest enemy of each team
+    // Spaceships of each team that can attack each square and the sum of
+    // their health. The totals add every team to answer threats in O(1).
+    unsigned short cover[N_TEAMS][MAP_MAX_Y][MAP_MAX_X];
+    int strength[N_TEAMS][MAP_MAX_Y][MAP_MAX_X];
+    unsigned short cover_total[MAP_MAX_Y][MAP_MAX_X];
+    int strength_total[MAP_MAX_Y][MAP_MAX_X];
+    // Fog of war: spaceships of each team that see each square, and one bit
+    // per square (row major) set while that count is not 0
+    int sensor_range;
+    unsigned short seen[N_TEAMS][MAP_MAX_Y][MAP_MAX_X];
+    uint64_t visible[N_TEAMS][MAP_VISIBLE_WORDS];
+    uint64_t terrain[MAP_VISIBLE_WORDS]; // One bit per square with an asteroid
+    // Spaceships of each team above and to the left of each square, one row
+    // and column more than the map, to count them in any window in O(1).
+    // Rebuilt at the end of each turn if splash is on.
+    unsigned short occupancy[N_TEAMS][MAP_MAX_Y + 1][MAP_MAX_X + 1];
+    // With continuous movement the squares of the spaceships are this
+    // state rounded down
+    kinetic_t kinetic;
+    admission_t admission[N_TEAMS];
+    unsigned int acked[N_TEAMS]; // seq of the last move out of each queue
+    unsigned int commits; // Changes published, futex of the readers
+#ifdef MAP_SPARSE
+    // Last so the pages of the chunks never used are never touched
+    map_chunk_t chunks[MAP_SPARSE_CHUNKS];
+#endif
 } map_t;
 
 typedef struct {
@@ -73,11 +197,20 @@ typedef struct {
     int objetiveY;
     int id_spaceship;
     int team;
+    int turn;         // map turn the move was decided on
+    int coalesced;    // Earlier moves of the spaceship this one replaces
+    unsigned int seq; // Set by loadgen to match its acknowledgements
+    float thrustx;    // Acceleration of a THRUST, squares per turn squared
+    float thrusty;
+    uint64_t flow;    // Trace flow of the message, 0 if not traced
 } move_t;
 
 typedef struct {
     int type;
     int id_spaceship;
+    int target_team; // Enemy assigned by the leader to an ATTACK, -1 if the
+    int target_id;   // spaceship has to look for one, AI_NO_TARGET to hold
+    uint64_t flow;   // Trace flow of the message, 0 if not traced
 } command_t;
 
 enum { READ = 0, WRITE = 1 };
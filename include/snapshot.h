@@ -0,0 +1,28 @@
+#ifndef SRC_SNAPSHOT_H_
+#define SRC_SNAPSHOT_H_
+
+#include <stdbool.h> // bool
+
+#include <simulator.h> // map_t
+
+/* Map of the last committed turn, for the agents of a pipelined match (see
+ * the simulator -p). There are two buffers: the simulator writes the one
+ * not published, so a reader only retries if two turns are published while
+ * it copies. Only the simulator writes it. */
+typedef struct {
+    int latest;          // Buffer of the last turn published, -1 if none
+    unsigned int seq[2]; // Odd while the buffer is written
+    map_t maps[2];
+} snapshot_t;
+
+void snapshot_init(snapshot_t* snapshot);
+
+/* Publishes map as the committed state of its turn. Must not run at the
+ * same time as the writes to map. */
+void snapshot_publish(snapshot_t* snapshot, map_t* map);
+
+/* Copies the last turn published into map. Returns false if there is none
+ * yet or the copy kept being overwritten. */
+bool snapshot_read(snapshot_t* snapshot, map_t* map);
+
+#endif /* SRC_SNAPSHOT_H_ */
@@ -0,0 +1,42 @@
+#ifndef SRC_TRACE_H_
+#define SRC_TRACE_H_
+
+#include <stdint.h> // uint64_t
+
+#include <simulator.h> // status
+
+#define TRACE_DIR_ENV "STELLAR_TRACE_DIR" // Directory of the traces, if set
+#define TRACE_MAX_EVENTS (1 << 16)        // Events kept by each process
+#define TRACE_FILE "trace.json"           // Merged trace in the directory
+
+/* Spans of a process, kept in memory with CLOCK_MONOTONIC timestamps, which
+ * every process shares. Each process writes its own file when it ends and
+ * the simulator merges them into TRACE_FILE in the Chrome trace event
+ * format. Flows join a span of a process with the one in another process
+ * that handles the same message. Everything is a no-op unless
+ * TRACE_DIR_ENV is set. Names must be string literals. */
+
+/* Starts tracing this process under name, such as "leader A". */
+void trace_init(const char* name);
+
+/* Timestamp to pass to trace_end, 0 if tracing is off. */
+uint64_t trace_begin();
+
+/* Records a span from start until now with an argument shown with it. */
+void trace_end(const char* name, uint64_t start, int arg);
+
+/* Starts a flow to the process that will get the message. Returns the id
+ * to send with it, 0 if tracing is off. Must be called inside a span. */
+uint64_t trace_flow_start();
+
+/* Ends at the current span the flow of a message received. */
+void trace_flow_end(uint64_t id);
+
+/* Writes the events of this process to its file in the directory. */
+void trace_flush();
+
+/* Merges the files of every process into TRACE_FILE and removes them.
+ * Must run after the other processes have flushed. */
+status trace_merge();
+
+#endif /* SRC_TRACE_H_ */
@@ -0,0 +1,286 @@
+#define _GNU_SOURCE
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "affinity.h"
+
+extern char team_symbols[N_TEAMS];
+
+static int read_cpu_list(const char* path, cpu_set_t* cpus);
+static int cache_domain(int cpu);
+static void siblings(int cpu, cpu_set_t* cpus);
+static int first_cpu(cpu_set_t* cpus);
+static void format_cpu_list(cpu_set_t* cpus, char* buf, size_t len);
+
+status affinity_plan(affinity_plan_t* plan)
+{
+    int i, j, k, cpu;
+    cpu_set_t allowed, reserved, pool, sibling;
+    int domain[CPU_SETSIZE];
+    int domains[CPU_SETSIZE];
+    int n_sharing, rank, size;
+
+    memset(plan, 0, sizeof(affinity_plan_t));
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+        return ERROR;
+    }
+    plan->n_cpus = CPU_COUNT(&allowed);
+
+    // The simulator and the monitor go first, each on its own core
+    CPU_ZERO(&reserved);
+    plan->simulator_cpu = first_cpu(&allowed);
+    siblings(plan->simulator_cpu, &sibling);
+    CPU_OR(&reserved, &reserved, &sibling);
+    CPU_SET(plan->simulator_cpu, &reserved);
+    CPU_XOR(&pool, &allowed, &reserved);
+    CPU_AND(&pool, &pool, &allowed);
+    plan->monitor_cpu =
+      CPU_COUNT(&pool) ? first_cpu(&pool) : plan->simulator_cpu;
+    siblings(plan->monitor_cpu, &sibling);
+    CPU_OR(&reserved, &reserved, &sibling);
+    CPU_SET(plan->monitor_cpu, &reserved);
+
+    // The teams get what is left. Without CPUs enough the siblings are
+    // used, and then everything.
+    CPU_XOR(&pool, &allowed, &reserved);
+    CPU_AND(&pool, &pool, &allowed);
+    if (CPU_COUNT(&pool) == 0) {
+        CPU_ZERO(&reserved);
+        CPU_SET(plan->simulator_cpu, &reserved);
+        CPU_SET(plan->monitor_cpu, &reserved);
+        CPU_XOR(&pool, &allowed, &reserved);
+        CPU_AND(&pool, &pool, &allowed);
+    }
+    if (CPU_COUNT(&pool) == 0) {
+        pool = allowed;
+    }
+
+    // Cache domains of the pool, in the order of their first CPU
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &pool)) {
+            continue;
+        }
+        domain[cpu] = cache_domain(cpu);
+        for (j = 0; j < plan->n_domains; j++) {
+            if (domains[j] == domain[cpu]) {
+                break;
+            }
+        }
+        if (j == plan->n_domains) {
+            domains[plan->n_domains++] = domain[cpu];
+        }
+    }
+
+    // Teams in the same domain split its CPUs in contiguous ranges
+    k = (plan->n_domains < N_TEAMS) ? plan->n_domains : N_TEAMS;
+    for (i = 0; i < N_TEAMS; i++) {
+        plan->team_domain[i] = domains[i % k];
+        n_sharing = (N_TEAMS - 1 - i % k) / k + 1;
+        rank = i / k;
+        for (cpu = 0, size = 0; cpu < CPU_SETSIZE; cpu++) {
+            size += CPU_ISSET(cpu, &pool) && domain[cpu] == domains[i % k];
+        }
+        CPU_ZERO(&plan->teams[i]);
+        for (cpu = 0, j = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, &pool) || domain[cpu] != domains[i % k]) {
+                continue;
+            }
+            // Fewer CPUs than teams in the domain: all of them are shared
+            if (size < n_sharing || (j >= rank * size / n_sharing &&
+                                     j < (rank + 1) * size / n_sharing)) {
+                CPU_SET(cpu, &plan->teams[i]);
+            }
+            j++;
+        }
+    }
+
+    return OK;
+}
+
+status affinity_pin_cpu(int cpu)
+{
+    cpu_set_t cpus;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+
+    return affinity_pin_set(&cpus);
+}
+
+status affinity_pin_set(cpu_set_t* cpus)
+{
+    return (sched_setaffinity(0, sizeof(cpu_set_t), cpus) == 0) ? OK : ERROR;
+}
+
+void affinity_report(affinity_plan_t* plan)
+{
+    int i;
+    char list[256];
+
+    fprintf(stdout,
+            "[AFFINITY] %d CPUs in %d cache domains...\n",
+            plan->n_cpus,
+            plan->n_domains);
+    fprintf(stdout,
+            "[AFFINITY] Simulator on CPU %d, monitor on CPU %d...\n",
+            plan->simulator_cpu,
+            plan->monitor_cpu);
+    for (i = 0; i < N_TEAMS; i++) {
+        format_cpu_list(&plan->teams[i], list, sizeof(list));
+        fprintf(stdout,
+                "[AFFINITY] Team %c on CPUs %s (domain of CPU %d)...\n",
+                team_symbols[i],
+                list,
+                plan->team_domain[i]);
+    }
+}
+
+/* Reads a list of CPUs such as "0-3,8". Returns the number of CPUs. */
+static int read_cpu_list(const char* path, cpu_set_t* cpus)
+{
+    FILE* f;
+    int first, last;
+    int c;
+
+    CPU_ZERO(cpus);
+    f = fopen(path, "r");
+    if (!f) {
+        return 0;
+    }
+    while (fscanf(f, "%d", &first) == 1) {
+        last = first;
+        c = fgetc(f);
+        if (c == '-') {
+            if (fscanf(f, "%d", &last) != 1) {
+                break;
+            }
+            c = fgetc(f);
+        }
+        for (; first <= last && first < CPU_SETSIZE; first++) {
+            CPU_SET(first, cpus);
+        }
+        if (c != ',') {
+            break;
+        }
+    }
+    fclose(f);
+
+    return CPU_COUNT(cpus);
+}
+
+/* First CPU sharing the last level cache with cpu. Without cache information
+ * the package is used. */
+static int cache_domain(int cpu)
+{
+    char path[PATH_MAX];
+    FILE* f;
+    int index, level, best = -1;
+    char type[32];
+    cpu_set_t shared, domain;
+
+    CPU_ZERO(&domain);
+    for (index = 0;; index++) {
+        snprintf(path,
+                 sizeof(path),
+                 AFFINITY_SYSFS "/cpu%d/cache/index%d/level",
+                 cpu,
+                 index);
+        f = fopen(path, "r");
+        if (!f) {
+            break;
+        }
+        if (fscanf(f, "%d", &level) != 1) {
+            level = -1;
+        }
+        fclose(f);
+
+        snprintf(path,
+                 sizeof(path),
+                 AFFINITY_SYSFS "/cpu%d/cache/index%d/type",
+                 cpu,
+                 index);
+        f = fopen(path, "r");
+        if (!f || fscanf(f, "%31s", type) != 1 ||
+            strcmp(type, "Instruction") == 0 || level <= best) {
+            if (f) {
+                fclose(f);
+            }
+            continue;
+        }
+        fclose(f);
+
+        snprintf(path,
+                 sizeof(path),
+                 AFFINITY_SYSFS "/cpu%d/cache/index%d/shared_cpu_list",
+                 cpu,
+                 index);
+        if (read_cpu_list(path, &shared)) {
+            best = level;
+            domain = shared;
+        }
+    }
+
+    if (best < 0) {
+        snprintf(path,
+                 sizeof(path),
+                 AFFINITY_SYSFS "/cpu%d/topology/package_cpus_list",
+                 cpu);
+        if (!read_cpu_list(path, &domain)) {
+            return 0;
+        }
+    }
+
+    return first_cpu(&domain);
+}
+
+/* Hyperthreads of the core of cpu, cpu included. */
+static void siblings(int cpu, cpu_set_t* cpus)
+{
+    char path[PATH_MAX];
+
+    snprintf(path,
+             sizeof(path),
+             AFFINITY_SYSFS "/cpu%d/topology/thread_siblings_list",
+             cpu);
+    if (!read_cpu_list(path, cpus)) {
+        CPU_SET(cpu, cpus);
+    }
+}
+
+static int first_cpu(cpu_set_t* cpus)
+{
+    int cpu;
+
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, cpus)) {
+            return cpu;
+        }
+    }
+
+    return 0;
+}
+
+static void format_cpu_list(cpu_set_t* cpus, char* buf, size_t len)
+{
+    int cpu, last;
+    size_t n = 0;
+
+    buf[0] = '\0';
+    for (cpu = 0; cpu < CPU_SETSIZE && n < len; cpu++) {
+        if (!CPU_ISSET(cpu, cpus)) {
+            continue;
+        }
+        for (last = cpu; last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus);
+             last++) {
+        }
+        if (last == cpu) {
+            n += snprintf(buf + n, len - n, "%s%d", n ? "," : "", cpu);
+        } else {
+            n += snprintf(
+              buf + n, len - n, "%s%d-%d", n ? "," : "", cpu, last);
+        }
+        cpu = last;
+    }
+}
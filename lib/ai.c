@@ -0,0 +1,399 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "ai.h"
+#include "flowfield.h"
+#include "map.h"
+
+// Buckets of enemies as big as the attack range, so the enemies in range of
+// a spaceship are in its bucket or the neighbour ones
+#define AI_BUCKET_SIZE ((MAX_ATACK_SCOPE > 0) ? MAX_ATACK_SCOPE : 1)
+#define AI_BUCKETS_Y ((MAP_MAX_Y + AI_BUCKET_SIZE - 1) / AI_BUCKET_SIZE)
+#define AI_BUCKETS_X ((MAP_MAX_X + AI_BUCKET_SIZE - 1) / AI_BUCKET_SIZE)
+#define AI_MAX_ENEMIES ((N_TEAMS - 1) * N_SPACESHIPS)
+
+static void begin_move(map_t* map,
+                       spaceship_t spaceship,
+                       int type,
+                       move_t* move);
+static bool in_range(spaceship_t spaceship, spaceship_t enemy);
+static void choose_weapon(map_t* map, spaceship_t spaceship, move_t* move);
+static int seen_enemies(map_t* map, int team, int posy, int posx);
+static void steer(map_t* map, spaceship_t spaceship, move_t* move);
+static float limit(float value, float max);
+
+unsigned int ai_rand_interval(unsigned int min,
+                              unsigned int max,
+                              unsigned int* seed)
+{
+    int r;
+    const unsigned int range = 1 + max - min;
+    const unsigned int buckets = RAND_MAX / range;
+    const unsigned int limit = buckets * range;
+
+    do {
+        r = rand_r(seed);
+    } while (r >= limit);
+
+    return min + (r / buckets);
+}
+
+int ai_leader_action(unsigned int* seed)
+{
+    return ai_rand_interval(0, 1, seed) ? ATTACK : MOVE;
+}
+
+spaceship_t ai_locate_enemy(map_t* map,
+                            spaceship_t spaceship,
+                            unsigned int* seed)
+{
+    int i, j, found = 0;
+    int miny, maxy, minx, maxx;
+    square_t square;
+    spaceship_t enemy, attacked_spaceship;
+
+    miny = spaceship.posy - MAX_ATACK_SCOPE;
+    maxy = spaceship.posy + MAX_ATACK_SCOPE;
+    minx = spaceship.posx - MAX_ATACK_SCOPE;
+    maxx = spaceship.posx + MAX_ATACK_SCOPE;
+    miny = (miny < 0) ? 0 : miny;
+    minx = (minx < 0) ? 0 : minx;
+    maxy = (maxy >= MAP_MAX_Y) ? MAP_MAX_Y - 1 : maxy;
+    maxx = (maxx >= MAP_MAX_X) ? MAP_MAX_X - 1 : maxx;
+
+    // Only the squares in range are read, through the view of the team
+    for (i = miny; i <= maxy; i++) {
+        for (j = minx; j <= maxx; j++) {
+            square = map_get_view(map, spaceship.team, i, j);
+            if (square.team < 0 || square.team == spaceship.team) {
+                continue;
+            }
+            enemy = map_get_spaceship(map, square.team, square.id_spaceship);
+            if (!enemy.alive) {
+                continue;
+            }
+            // Reservoir sampling, every enemy in sight is equally likely
+            if (rand_r(seed) % ++found == 0) {
+                attacked_spaceship = enemy;
+            }
+        }
+    }
+
+    // Not found an enemy spaceship in range or alive
+    if (!found) {
+        attacked_spaceship.id = -1;
+    }
+
+    return attacked_spaceship;
+}
+
+bool ai_spaceship_move(map_t* map,
+                       spaceship_t spaceship,
+                       int type,
+                       move_t* move,
+                       unsigned int* seed)
+{
+    int posx, posy, x, y;
+    int dist, best, ties = 1;
+    int threat, best_threat;
+    bool explore;
+    spaceship_t attacked_spaceship;
+
+    begin_move(map, spaceship, type, move);
+    switch (type) {
+        case ATTACK:
+            attacked_spaceship = ai_locate_enemy(map, spaceship, seed);
+            if (attacked_spaceship.id == -1) {
+                return false;
+            }
+            move->objetiveX = attacked_spaceship.posx;
+            move->objetiveY = attacked_spaceship.posy;
+            choose_weapon(map, spaceship, move);
+            return true;
+        case MOVE:
+            // Go down the flow field of the team towards the nearest enemy in
+            // sight. Staying is a valid move if no neighbour gets us closer,
+            // and with no enemy in sight any empty square is as good.
+            posx = spaceship.posx;
+            posy = spaceship.posy;
+            best = flowfield_get(map, spaceship.team, posy, posx);
+            explore = (best == FLOW_UNREACHABLE);
+            best_threat = map_get_threat(map, spaceship.team, posy, posx);
+            for (y = spaceship.posy - MOVE_RANGE;
+                 y <= spaceship.posy + MOVE_RANGE;
+                 y++) {
+                if (y < 0 || y >= MAP_MAX_Y) {
+                    continue;
+                }
+                for (x = spaceship.posx - MOVE_RANGE;
+                     x <= spaceship.posx + MOVE_RANGE;
+                     x++) {
+                    if (x < 0 || x >= MAP_MAX_X ||
+                        map_get_view(map, spaceship.team, y, x).team != -1) {
+                        continue;
+                    }
+                    dist = flowfield_get(map, spaceship.team, y, x);
+                    threat = map_get_threat(map, spaceship.team, y, x);
+                    // Ties go to the safest square, then at random so
+                    // spaceships do not pile up
+                    if (dist < best ||
+                        (dist == best && dist != FLOW_UNREACHABLE &&
+                         threat < best_threat)) {
+                        best = dist;
+                        best_threat = threat;
+                        ties = 1;
+                        posx = x;
+                        posy = y;
+                    } else if (dist == best &&
+                               (explore || (threat == best_threat &&
+                                            (posx != spaceship.posx ||
+                                             posy != spaceship.posy))) &&
+                               rand_r(seed) % ++ties == 0) {
+                        posx = x;
+                        posy = y;
+                    }
+                }
+            }
+            move->objetiveX = posx;
+            move->objetiveY = posy;
+            if (map->continuous) {
+                steer(map, spaceship, move);
+            }
+            return true;
+    }
+
+    return false;
+}
+
+void ai_assign_targets(map_t* map, int team, spaceship_t targets[N_SPACESHIPS])
+{
+    int i, j, k, y, x, b;
+    int n_enemies = 0, best, dist, best_dist;
+    spaceship_t spaceship, enemy;
+    spaceship_t enemies[AI_MAX_ENEMIES];
+    int shots[AI_MAX_ENEMIES]; // Shots still needed to destroy each enemy
+    int bucket[AI_MAX_ENEMIES];
+    int start[AI_BUCKETS_Y * AI_BUCKETS_X + 1] = { 0 };
+    int next[AI_BUCKETS_Y * AI_BUCKETS_X];
+    int sorted[AI_MAX_ENEMIES]; // Enemies sorted by bucket
+    int candidates[N_SPACESHIPS][AI_MAX_ENEMIES];
+    int n_candidates[N_SPACESHIPS];
+    int order[N_SPACESHIPS];
+    int n_order = 0;
+
+    // Enemies in sight, counted by bucket
+    for (i = 0; i < N_TEAMS; i++) {
+        for (j = 0; j < N_SPACESHIPS && i != team; j++) {
+            enemy = map_get_spaceship(map, i, j);
+            if (!enemy.alive ||
+                !map_is_visible(map, team, enemy.posy, enemy.posx)) {
+                continue;
+            }
+            enemies[n_enemies] = enemy;
+            shots[n_enemies] = (enemy.health + ATACK_DAMAGE - 1) / ATACK_DAMAGE;
+            bucket[n_enemies] = (enemy.posy / AI_BUCKET_SIZE) * AI_BUCKETS_X +
+                                enemy.posx / AI_BUCKET_SIZE;
+            start[bucket[n_enemies] + 1]++;
+            n_enemies++;
+        }
+    }
+    for (b = 0; b < AI_BUCKETS_Y * AI_BUCKETS_X; b++) {
+        start[b + 1] += start[b];
+        next[b] = start[b];
+    }
+    for (k = 0; k < n_enemies; k++) {
+        sorted[next[bucket[k]]++] = k;
+    }
+
+    // Enemies in range of each spaceship, from its bucket and the neighbours
+    for (j = 0; j < N_SPACESHIPS; j++) {
+        targets[j].team = -1;
+        targets[j].id = AI_NO_TARGET;
+        n_candidates[j] = 0;
+        spaceship = map_get_spaceship(map, team, j);
+        if (!spaceship.alive) {
+            continue;
+        }
+        for (y = spaceship.posy / AI_BUCKET_SIZE - 1;
+             y <= spaceship.posy / AI_BUCKET_SIZE + 1;
+             y++) {
+            for (x = spaceship.posx / AI_BUCKET_SIZE - 1;
+                 x <= spaceship.posx / AI_BUCKET_SIZE + 1;
+                 x++) {
+                if (y < 0 || y >= AI_BUCKETS_Y || x < 0 || x >= AI_BUCKETS_X) {
+                    continue;
+                }
+                b = y * AI_BUCKETS_X + x;
+                for (k = start[b]; k < start[b + 1]; k++) {
+                    if (in_range(spaceship, enemies[sorted[k]])) {
+                        candidates[j][n_candidates[j]++] = sorted[k];
+                    }
+                }
+            }
+        }
+        // Spaceships with fewer choices choose first
+        if (n_candidates[j]) {
+            for (k = n_order;
+                 k > 0 && n_candidates[order[k - 1]] > n_candidates[j];
+                 k--) {
+                order[k] = order[k - 1];
+            }
+            order[k] = j;
+            n_order++;
+        }
+    }
+
+    // Greedy: the enemy closest to be destroyed, then the nearest one
+    for (i = 0; i < n_order; i++) {
+        j = order[i];
+        spaceship = map_get_spaceship(map, team, j);
+        best = -1;
+        best_dist = 0;
+        for (k = 0; k < n_candidates[j]; k++) {
+            enemy = enemies[candidates[j][k]];
+            if (shots[candidates[j][k]] == 0) {
+                continue;
+            }
+            dist = map_get_distance(
+              map, spaceship.posy, spaceship.posx, enemy.posy, enemy.posx);
+            if (best < 0 || shots[candidates[j][k]] < shots[best] ||
+                (shots[candidates[j][k]] == shots[best] && dist < best_dist)) {
+                best = candidates[j][k];
+                best_dist = dist;
+            }
+        }
+        if (best >= 0) {
+            targets[j] = enemies[best];
+            shots[best]--;
+        }
+    }
+}
+
+bool ai_spaceship_attack(map_t* map,
+                         spaceship_t spaceship,
+                         int target_team,
+                         int target_id,
+                         move_t* move,
+                         unsigned int* seed)
+{
+    spaceship_t target;
+
+    // Firing at random would only add shots to enemies that get enough
+    if (target_id == AI_NO_TARGET) {
+        return false;
+    }
+    if (target_team < 0 || target_team >= N_TEAMS ||
+        target_team == spaceship.team || target_id < 0 ||
+        target_id >= N_SPACESHIPS) {
+        return ai_spaceship_move(map, spaceship, ATTACK, move, seed);
+    }
+
+    // The map may have changed since the leader chose
+    target = map_get_spaceship(map, target_team, target_id);
+    if (!target.alive || !in_range(spaceship, target) ||
+        !map_is_visible(map, spaceship.team, target.posy, target.posx)) {
+        return ai_spaceship_move(map, spaceship, ATTACK, move, seed);
+    }
+    begin_move(map, spaceship, ATTACK, move);
+    move->objetiveX = target.posx;
+    move->objetiveY = target.posy;
+    choose_weapon(map, spaceship, move);
+
+    return true;
+}
+
+static void begin_move(map_t* map,
+                       spaceship_t spaceship,
+                       int type,
+                       move_t* move)
+{
+    move->type = type;
+    move->originX = spaceship.posx;
+    move->originY = spaceship.posy;
+    move->id_spaceship = spaceship.id;
+    move->team = spaceship.team;
+    move->turn = map->turn;
+    move->coalesced = 0;
+    move->seq = 0;
+    move->thrustx = move->thrusty = 0;
+    move->flow = 0;
+}
+
+/* With splash weapons, an attack becomes a SPLASH if the blast would hit
+ * more than one enemy and no friend. The counts are those of the end of the
+ * last turn, and they include enemies in the fog. */
+static void choose_weapon(map_t* map, spaceship_t spaceship, move_t* move)
+{
+    int i, enemies = 0;
+
+    if (!map->splash || map_count_spaceships(map,
+                                             spaceship.team,
+                                             move->objetiveY,
+                                             move->objetiveX,
+                                             SPLASH_RADIUS)) {
+        return;
+    }
+    // The sums also count the enemies in the fog, so they only bound the
+    // ones the team sees
+    for (i = 0; i < N_TEAMS; i++) {
+        if (i != spaceship.team) {
+            enemies += map_count_spaceships(
+              map, i, move->objetiveY, move->objetiveX, SPLASH_RADIUS);
+        }
+    }
+    if (enemies > 1 &&
+        seen_enemies(map, spaceship.team, move->objetiveY, move->objetiveX) >
+          1) {
+        move->type = SPLASH;
+    }
+}
+
+/* Enemies of team that it sees at most SPLASH_RADIUS squares away. */
+static int seen_enemies(map_t* map, int team, int posy, int posx)
+{
+    int i, j, enemies = 0;
+    square_t square;
+
+    for (i = posy - SPLASH_RADIUS; i <= posy + SPLASH_RADIUS; i++) {
+        for (j = posx - SPLASH_RADIUS; j <= posx + SPLASH_RADIUS; j++) {
+            if (i < 0 || i >= MAP_MAX_Y || j < 0 || j >= MAP_MAX_X) {
+                continue;
+            }
+            square = map_get_view(map, team, i, j);
+            if (square.team >= 0 && square.team != team) {
+                enemies++;
+            }
+        }
+    }
+
+    return enemies;
+}
+
+/* With continuous movement the square chosen becomes a THRUST that would
+ * take the spaceship to its center in one turn: a displacement d from
+ * velocity v in one turn needs an acceleration of 2 (d - v). */
+static void steer(map_t* map, spaceship_t spaceship, move_t* move)
+{
+    int i = spaceship.team * N_SPACESHIPS + spaceship.id;
+    kinetic_t* kinetic = &map->kinetic;
+
+    move->type = THRUST;
+    move->thrustx =
+      limit(2 * (move->objetiveX + 0.5f - kinetic->posx[i] - kinetic->velx[i]),
+            KINETIC_MAX_THRUST);
+    move->thrusty =
+      limit(2 * (move->objetiveY + 0.5f - kinetic->posy[i] - kinetic->vely[i]),
+            KINETIC_MAX_THRUST);
+}
+
+static float limit(float value, float max)
+{
+    return (value > max) ? max : (value < -max) ? -max : value;
+}
+
+/* Same square window as ai_locate_enemy. */
+static bool in_range(spaceship_t spaceship, spaceship_t enemy)
+{
+    return abs(enemy.posy - spaceship.posy) <= MAX_ATACK_SCOPE &&
+           abs(enemy.posx - spaceship.posx) <= MAX_ATACK_SCOPE;
+}
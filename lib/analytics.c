@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analytics.h"
+#include "map.h"
+
+#define ANALYTICS_INITIAL_ROWS 256
+
+// Names of the columns, in the order of their enums
+static const char* turn_columns[N_TURN_COLUMNS] = {
+    "turn",   "moves",   "invalid",   "blocked",      "moved",
+    "missed", "damaged", "destroyed", "resolve_usec", "turn_usec"
+};
+static const char* team_columns[N_TEAM_COLUMNS] = {
+    "turn",         "team",         "moved", "distance",
+    "attacks",      "hits",         "damage_dealt",
+    "damage_taken", "kills",        "losses",
+    "alive",        "health"
+};
+
+static void init_table(analytics_table_t* table,
+                       const char* name,
+                       const char** columns,
+                       int n_columns);
+static status append_row(analytics_table_t* table, int32_t* row);
+static bool in_blast(blasts_t* blasts, int k, spaceship_t spaceship);
+static long elapsed_usec(struct timespec* start);
+
+void analytics_init(analytics_t* analytics)
+{
+    memset(analytics, 0, sizeof(analytics_t));
+    init_table(&analytics->tables[0], "turns", turn_columns, N_TURN_COLUMNS);
+    init_table(&analytics->tables[1], "teams", team_columns, N_TEAM_COLUMNS);
+}
+
+void analytics_free(analytics_t* analytics)
+{
+    int i, j;
+    analytics_table_t* table;
+
+    for (i = 0; i < ANALYTICS_N_TABLES; i++) {
+        table = &analytics->tables[i];
+        for (j = 0; j < ANALYTICS_MAX_COLUMNS; j++) {
+            free(table->data[j]);
+            table->data[j] = NULL;
+        }
+        table->n_rows = table->capacity = 0;
+    }
+}
+
+void analytics_begin_turn(analytics_t* analytics)
+{
+    clock_gettime(CLOCK_MONOTONIC, &analytics->turn_start);
+}
+
+void analytics_add_move(analytics_t* analytics,
+                        move_t move,
+                        outcome_t outcome,
+                        spaceship_t* target,
+                        long usec)
+{
+    int32_t* team = NULL;
+    int32_t* enemy;
+
+    analytics->turn_row[TURN_COL_MOVES]++;
+    analytics->turn_row[TURN_COL_RESOLVE_USEC] += usec;
+    if (outcome != OUTCOME_INVALID) {
+        team = analytics->team_rows[move.team];
+    }
+
+    switch (outcome) {
+        case OUTCOME_INVALID:
+            analytics->turn_row[TURN_COL_INVALID]++;
+            break;
+        case OUTCOME_BLOCKED:
+            analytics->turn_row[TURN_COL_BLOCKED]++;
+            break;
+        case OUTCOME_MOVED:
+            analytics->turn_row[TURN_COL_MOVED]++;
+            team[TEAM_COL_MOVED]++;
+            team[TEAM_COL_DISTANCE] += map_get_distance(NULL,
+                                                        move.originY,
+                                                        move.originX,
+                                                        move.objetiveY,
+                                                        move.objetiveX);
+            break;
+        case OUTCOME_MISSED:
+            analytics->turn_row[TURN_COL_MISSED]++;
+            team[TEAM_COL_ATTACKS]++;
+            break;
+        case OUTCOME_LAUNCHED:
+            // Its hits are accounted by analytics_add_blasts
+            team[TEAM_COL_ATTACKS]++;
+            break;
+        case OUTCOME_THRUST:
+            // The squares travelled are only known at the end of the turn
+            analytics->turn_row[TURN_COL_MOVED]++;
+            team[TEAM_COL_MOVED]++;
+            break;
+        case OUTCOME_DAMAGED:
+        case OUTCOME_DESTROYED:
+            enemy = analytics->team_rows[target->team];
+            team[TEAM_COL_ATTACKS]++;
+            team[TEAM_COL_HITS]++;
+            team[TEAM_COL_DAMAGE_DEALT] += ATACK_DAMAGE;
+            enemy[TEAM_COL_DAMAGE_TAKEN] += ATACK_DAMAGE;
+            if (outcome == OUTCOME_DAMAGED) {
+                analytics->turn_row[TURN_COL_DAMAGED]++;
+            } else {
+                analytics->turn_row[TURN_COL_DESTROYED]++;
+                team[TEAM_COL_KILLS]++;
+                enemy[TEAM_COL_LOSSES]++;
+            }
+            break;
+    }
+}
+
+void analytics_add_blasts(analytics_t* analytics,
+                          blasts_t* blasts,
+                          spaceship_t* victims,
+                          int n_victims)
+{
+    int i, k, killer;
+    int32_t* enemy;
+
+    for (k = 0; k < blasts->n; k++) {
+        for (i = 0; i < n_victims; i++) {
+            if (in_blast(blasts, k, victims[i])) {
+                analytics->team_rows[blasts->team[k]][TEAM_COL_HITS]++;
+                break;
+            }
+        }
+    }
+
+    for (i = 0; i < n_victims; i++) {
+        enemy = analytics->team_rows[victims[i].team];
+        killer = -1;
+        for (k = 0; k < blasts->n; k++) {
+            if (!in_blast(blasts, k, victims[i])) {
+                continue;
+            }
+            analytics->team_rows[blasts->team[k]][TEAM_COL_DAMAGE_DEALT] +=
+              SPLASH_DAMAGE;
+            enemy[TEAM_COL_DAMAGE_TAKEN] += SPLASH_DAMAGE;
+            if (killer < 0 && blasts->team[k] != victims[i].team) {
+                killer = blasts->team[k];
+            }
+        }
+        if (victims[i].alive) {
+            analytics->turn_row[TURN_COL_DAMAGED]++;
+        } else {
+            analytics->turn_row[TURN_COL_DESTROYED]++;
+            enemy[TEAM_COL_LOSSES]++;
+            if (killer >= 0) {
+                analytics->team_rows[killer][TEAM_COL_KILLS]++;
+            }
+        }
+    }
+}
+
+status analytics_end_turn(analytics_t* analytics, map_t* map, int turn)
+{
+    int i, j;
+    int32_t* team;
+    spaceship_t spaceship;
+    status ret = OK;
+
+    analytics->turn_row[TURN_COL_TURN] = turn;
+    analytics->turn_row[TURN_COL_TURN_USEC] =
+      elapsed_usec(&analytics->turn_start);
+    if (!append_row(&analytics->tables[0], analytics->turn_row)) {
+        ret = ERROR;
+    }
+
+    for (i = 0; i < N_TEAMS; i++) {
+        team = analytics->team_rows[i];
+        team[TEAM_COL_TURN] = turn;
+        team[TEAM_COL_TEAM] = i;
+        for (j = 0; j < N_SPACESHIPS; j++) {
+            spaceship = map_get_spaceship(map, i, j);
+            if (spaceship.alive) {
+                team[TEAM_COL_ALIVE]++;
+                team[TEAM_COL_HEALTH] += spaceship.health;
+            }
+        }
+        if (!append_row(&analytics->tables[1], team)) {
+            ret = ERROR;
+        }
+    }
+
+    memset(analytics->turn_row, 0, sizeof(analytics->turn_row));
+    memset(analytics->team_rows, 0, sizeof(analytics->team_rows));
+
+    return ret;
+}
+
+status analytics_write(analytics_t* analytics, const char* path)
+{
+    FILE* f;
+    int i;
+    uint32_t j;
+    uint32_t header[3] = { ANALYTICS_MAGIC,
+                           ANALYTICS_VERSION,
+                           ANALYTICS_N_TABLES };
+    analytics_table_t* table;
+    status ret = OK;
+
+    f = fopen(path, "wb");
+    if (!f) {
+        perror("[ANALYTICS] Error creating the file...\n");
+        return ERROR;
+    }
+
+    if (fwrite(header, sizeof(header), 1, f) != 1) {
+        ret = ERROR;
+    }
+    for (i = 0; i < ANALYTICS_N_TABLES && ret; i++) {
+        table = &analytics->tables[i];
+        if (fwrite(table->name, ANALYTICS_NAME_SIZE, 1, f) != 1 ||
+            fwrite(&table->n_columns, sizeof(uint32_t), 1, f) != 1 ||
+            fwrite(&table->n_rows, sizeof(uint32_t), 1, f) != 1 ||
+            fwrite(table->columns,
+                   ANALYTICS_NAME_SIZE,
+                   table->n_columns,
+                   f) != table->n_columns) {
+            ret = ERROR;
+            break;
+        }
+        for (j = 0; j < table->n_columns; j++) {
+            if (fwrite(table->data[j], sizeof(int32_t), table->n_rows, f) !=
+                table->n_rows) {
+                ret = ERROR;
+                break;
+            }
+        }
+    }
+
+    if (fclose(f) != 0 || !ret) {
+        perror("[ANALYTICS] Error writing the file...\n");
+        return ERROR;
+    }
+
+    return OK;
+}
+
+status analytics_load(analytics_t* analytics, const char* path)
+{
+    FILE* f;
+    int i;
+    uint32_t j;
+    uint32_t header[3];
+    analytics_table_t* table;
+
+    memset(analytics, 0, sizeof(analytics_t));
+    f = fopen(path, "rb");
+    if (!f) {
+        perror("[ANALYTICS] Error opening the file...\n");
+        return ERROR;
+    }
+
+    if (fread(header, sizeof(header), 1, f) != 1 ||
+        header[0] != ANALYTICS_MAGIC || header[1] != ANALYTICS_VERSION ||
+        header[2] != ANALYTICS_N_TABLES) {
+        fprintf(stderr, "[ANALYTICS] Not an analytics file...\n");
+        fclose(f);
+        return ERROR;
+    }
+
+    for (i = 0; i < ANALYTICS_N_TABLES; i++) {
+        table = &analytics->tables[i];
+        if (fread(table->name, ANALYTICS_NAME_SIZE, 1, f) != 1 ||
+            fread(&table->n_columns, sizeof(uint32_t), 1, f) != 1 ||
+            fread(&table->n_rows, sizeof(uint32_t), 1, f) != 1 ||
+            table->n_columns > ANALYTICS_MAX_COLUMNS ||
+            fread(table->columns,
+                  ANALYTICS_NAME_SIZE,
+                  table->n_columns,
+                  f) != table->n_columns) {
+            break;
+        }
+        table->name[ANALYTICS_NAME_SIZE - 1] = '\0';
+        table->capacity = table->n_rows;
+        for (j = 0; j < table->n_columns; j++) {
+            table->columns[j][ANALYTICS_NAME_SIZE - 1] = '\0';
+            table->data[j] = malloc(table->n_rows * sizeof(int32_t) + 1);
+            if (!table->data[j] ||
+                fread(table->data[j], sizeof(int32_t), table->n_rows, f) !=
+                  table->n_rows) {
+                break;
+            }
+        }
+        if (j < table->n_columns) {
+            break;
+        }
+    }
+    fclose(f);
+
+    if (i < ANALYTICS_N_TABLES) {
+        fprintf(stderr, "[ANALYTICS] Truncated file...\n");
+        analytics_free(analytics);
+        return ERROR;
+    }
+
+    return OK;
+}
+
+static void init_table(analytics_table_t* table,
+                       const char* name,
+                       const char** columns,
+                       int n_columns)
+{
+    int i;
+
+    strncpy(table->name, name, ANALYTICS_NAME_SIZE - 1);
+    table->n_columns = n_columns;
+    for (i = 0; i < n_columns; i++) {
+        strncpy(table->columns[i], columns[i], ANALYTICS_NAME_SIZE - 1);
+    }
+}
+
+/* Appends a row. The columns double their size when they are full, so a
+ * match only reallocates them a logarithmic number of times. */
+static status append_row(analytics_table_t* table, int32_t* row)
+{
+    uint32_t i, capacity;
+    int32_t* column;
+
+    if (table->n_rows == table->capacity) {
+        capacity = table->capacity ? 2 * table->capacity
+                                   : ANALYTICS_INITIAL_ROWS;
+        for (i = 0; i < table->n_columns; i++) {
+            column = realloc(table->data[i], capacity * sizeof(int32_t));
+            if (!column) {
+                return ERROR;
+            }
+            table->data[i] = column;
+        }
+        table->capacity = capacity;
+    }
+
+    for (i = 0; i < table->n_columns; i++) {
+        table->data[i][table->n_rows] = row[i];
+    }
+    table->n_rows++;
+
+    return OK;
+}
+
+/* True if spaceship is at most SPLASH_RADIUS squares from blast k. */
+static bool in_blast(blasts_t* blasts, int k, spaceship_t spaceship)
+{
+    return abs(spaceship.posy - blasts->posy[k]) <= SPLASH_RADIUS &&
+           abs(spaceship.posx - blasts->posx[k]) <= SPLASH_RADIUS;
+}
+
+static long elapsed_usec(struct timespec* start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1000000L +
+           (now.tv_nsec - start->tv_nsec) / 1000;
+}
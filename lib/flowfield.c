@@ -0,0 +1,79 @@
+#include <stdbool.h>
+
+#include "flowfield.h"
+#include "map.h"
+
+static void update_team(map_t* map, int team);
+
+// Queue of the breadth first search, shared by every team
+static int queue[MAP_MAX_Y * MAP_MAX_X];
+
+void flowfield_update(map_t* map)
+{
+    int i;
+
+    for (i = 0; i < N_TEAMS; i++) {
+        update_team(map, i);
+    }
+}
+
+int flowfield_get(map_t* map, int team, int posy, int posx)
+{
+    return map->flow[team][posy][posx];
+}
+
+static void update_team(map_t* map, int team)
+{
+    int i, j;
+    int head = 0, tail = 0;
+    int posy, posx, nexty, nextx;
+    unsigned short dist;
+    unsigned short(*flow)[MAP_MAX_X] = map->flow[team];
+    spaceship_t spaceship;
+
+    for (i = 0; i < MAP_MAX_Y; i++) {
+        for (j = 0; j < MAP_MAX_X; j++) {
+            flow[i][j] = FLOW_UNREACHABLE;
+        }
+    }
+
+    // Every enemy spaceship in sight of the team is a source
+    for (i = 0; i < N_TEAMS; i++) {
+        if (i == team) {
+            continue;
+        }
+        for (j = 0; j < N_SPACESHIPS; j++) {
+            spaceship = map_get_spaceship(map, i, j);
+            if (spaceship.alive &&
+                map_is_visible(map, team, spaceship.posy, spaceship.posx)) {
+                flow[spaceship.posy][spaceship.posx] = 0;
+                queue[tail++] = spaceship.posy * MAP_MAX_X + spaceship.posx;
+            }
+        }
+    }
+
+    // A spaceship moves to any of its 8 neighbours, so a move costs 1 in the
+    // Chebyshev metric
+    while (head < tail) {
+        posy = queue[head] / MAP_MAX_X;
+        posx = queue[head] % MAP_MAX_X;
+        head++;
+        dist = flow[posy][posx] + 1;
+        for (nexty = posy - MOVE_RANGE; nexty <= posy + MOVE_RANGE; nexty++) {
+            if (nexty < 0 || nexty >= MAP_MAX_Y) {
+                continue;
+            }
+            for (nextx = posx - MOVE_RANGE; nextx <= posx + MOVE_RANGE;
+                 nextx++) {
+                if (nextx < 0 || nextx >= MAP_MAX_X ||
+                    flow[nexty][nextx] != FLOW_UNREACHABLE) {
+                    continue;
+                }
+                flow[nexty][nextx] = dist;
+                if (map_is_square_empty(map, nexty, nextx)) {
+                    queue[tail++] = nexty * MAP_MAX_X + nextx;
+                }
+            }
+        }
+    }
+}
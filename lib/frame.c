@@ -0,0 +1,340 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "frame.h"
+#include "map.h"
+
+#define FIELD_POSX 0x01
+#define FIELD_POSY 0x02
+#define FIELD_HEALTH 0x04
+#define FIELD_ALIVE 0x08 // alive flag changed
+#define FLAG_ALIVE 0x10  // value of the alive flag
+
+static unsigned int zigzag(int value);
+static int unzigzag(unsigned int value);
+static bool on_map(spaceship_t* spaceship);
+static void place_spaceships(map_t* map,
+                             spaceship_t next[N_TEAMS][N_SPACESHIPS],
+                             bool moved[N_TEAMS][N_SPACESHIPS]);
+
+size_t frame_put_varint(unsigned char* buf, unsigned int value)
+{
+    size_t n = 0;
+
+    while (value >= 0x80) {
+        buf[n++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    buf[n++] = value;
+
+    return n;
+}
+
+size_t frame_get_varint(unsigned char* buf, size_t len, unsigned int* value)
+{
+    size_t n;
+    unsigned int shift;
+
+    *value = 0;
+    for (n = 0, shift = 0; n < len && n < FRAME_MAX_VARINT; n++, shift += 7) {
+        *value |= (unsigned int)(buf[n] & 0x7f) << shift;
+        if (!(buf[n] & 0x80)) {
+            return n + 1;
+        }
+    }
+
+    // Truncated or too long
+    return 0;
+}
+
+size_t frame_encode_key(spaceship_t cur[N_TEAMS][N_SPACESHIPS],
+                        uint64_t terrain[MAP_VISIBLE_WORDS],
+                        unsigned char* buf)
+{
+    int i, j, bit, last_bit;
+    size_t n = 0;
+    unsigned int n_asteroids = 0;
+    spaceship_t spaceship;
+
+    for (i = 0; i < N_TEAMS; i++) {
+        for (j = 0; j < N_SPACESHIPS; j++) {
+            spaceship = cur[i][j];
+            buf[n++] = spaceship.alive ? FLAG_ALIVE : 0;
+            n += frame_put_varint(buf + n, spaceship.posx);
+            n += frame_put_varint(buf + n, spaceship.posy);
+            n += frame_put_varint(buf + n, zigzag(spaceship.health));
+        }
+    }
+
+    // Asteroids as the gaps between their squares in row major order
+    for (i = 0; terrain && i < MAP_VISIBLE_WORDS; i++) {
+        n_asteroids += __builtin_popcountll(terrain[i]);
+    }
+    n += frame_put_varint(buf + n, n_asteroids);
+    for (bit = 0, last_bit = -1; n_asteroids > 0; bit++) {
+        if ((terrain[bit / 64] >> (bit % 64)) & 1) {
+            n += frame_put_varint(buf + n, bit - last_bit - 1);
+            last_bit = bit;
+            n_asteroids--;
+        }
+    }
+
+    return n;
+}
+
+size_t frame_encode_delta(spaceship_t prev[N_TEAMS][N_SPACESHIPS],
+                          spaceship_t cur[N_TEAMS][N_SPACESHIPS],
+                          unsigned char* buf)
+{
+    int i, j;
+    int index, last_index;
+    unsigned char fields;
+    unsigned char body[FRAME_MAX_SIZE];
+    size_t n = 0;
+    unsigned int n_changed = 0;
+    spaceship_t old, new;
+
+    for (i = 0, last_index = -1; i < N_TEAMS; i++) {
+        for (j = 0; j < N_SPACESHIPS; j++) {
+            old = prev[i][j];
+            new = cur[i][j];
+            fields = 0;
+            if (new.posx != old.posx) {
+                fields |= FIELD_POSX;
+            }
+            if (new.posy != old.posy) {
+                fields |= FIELD_POSY;
+            }
+            if (new.health != old.health) {
+                fields |= FIELD_HEALTH;
+            }
+            if (new.alive != old.alive) {
+                fields |= FIELD_ALIVE;
+            }
+            if (!fields) {
+                continue;
+            }
+            if (new.alive) {
+                fields |= FLAG_ALIVE;
+            }
+
+            // Indexes are increasing so we only store the gap
+            index = i * N_SPACESHIPS + j;
+            n += frame_put_varint(body + n, index - last_index - 1);
+            last_index = index;
+            body[n++] = fields;
+            if (fields & FIELD_POSX) {
+                n += frame_put_varint(body + n, zigzag(new.posx - old.posx));
+            }
+            if (fields & FIELD_POSY) {
+                n += frame_put_varint(body + n, zigzag(new.posy - old.posy));
+            }
+            if (fields & FIELD_HEALTH) {
+                n += frame_put_varint(body + n,
+                                      zigzag(new.health - old.health));
+            }
+            n_changed++;
+        }
+    }
+
+    index = frame_put_varint(buf, n_changed);
+    for (i = 0; i < n; i++) {
+        buf[index + i] = body[i];
+    }
+
+    return index + n;
+}
+
+status frame_apply(map_t* map, int type, unsigned char* buf, size_t len)
+{
+    int i, j, bit;
+    size_t n = 0, r;
+    unsigned int value, n_changed, gap;
+    unsigned char fields;
+    int index;
+    bool moved[N_TEAMS][N_SPACESHIPS] = { { false } };
+    spaceship_t next[N_TEAMS][N_SPACESHIPS];
+    spaceship_t* spaceship;
+
+    for (i = 0; i < N_TEAMS; i++) {
+        for (j = 0; j < N_SPACESHIPS; j++) {
+            next[i][j] = map_get_spaceship(map, i, j);
+        }
+    }
+
+    if (type == FRAME_KEY) {
+        for (i = 0; i < N_TEAMS; i++) {
+            for (j = 0; j < N_SPACESHIPS; j++) {
+                if (n >= len) {
+                    return ERROR;
+                }
+                spaceship = &next[i][j];
+                fields = buf[n++];
+                spaceship->alive = (fields & FLAG_ALIVE) != 0;
+                if (!(r = frame_get_varint(buf + n, len - n, &value))) {
+                    return ERROR;
+                }
+                spaceship->posx = value;
+                n += r;
+                if (!(r = frame_get_varint(buf + n, len - n, &value))) {
+                    return ERROR;
+                }
+                spaceship->posy = value;
+                n += r;
+                if (!(r = frame_get_varint(buf + n, len - n, &value))) {
+                    return ERROR;
+                }
+                spaceship->health = unzigzag(value);
+                n += r;
+                if (!on_map(spaceship)) {
+                    return ERROR;
+                }
+                spaceship->team = i;
+                spaceship->id = j;
+                moved[i][j] = true;
+            }
+        }
+        for (i = 0; i < MAP_MAX_Y; i++) {
+            for (j = 0; j < MAP_MAX_X; j++) {
+                map_clean_square(map, i, j);
+            }
+        }
+        // Keyframes of older recordings end before the terrain
+        if (n < len) {
+            if (!(r = frame_get_varint(buf + n, len - n, &n_changed))) {
+                return ERROR;
+            }
+            n += r;
+            for (bit = -1; n_changed > 0; n_changed--) {
+                if (!(r = frame_get_varint(buf + n, len - n, &gap))) {
+                    return ERROR;
+                }
+                n += r;
+                bit += gap + 1;
+                if (bit >= MAP_MAX_Y * MAP_MAX_X) {
+                    return ERROR;
+                }
+                map_set_asteroid(map, bit / MAP_MAX_X, bit % MAP_MAX_X);
+            }
+        }
+        place_spaceships(map, next, moved);
+        // The map may not have been valid before a keyframe
+        map->hash = map_compute_hash(map);
+        return OK;
+    }
+
+    if (type != FRAME_DELTA) {
+        return ERROR;
+    }
+
+    if (!(r = frame_get_varint(buf, len, &n_changed))) {
+        return ERROR;
+    }
+    n += r;
+    for (index = -1; n_changed > 0; n_changed--) {
+        if (!(r = frame_get_varint(buf + n, len - n, &gap)) || n + r >= len) {
+            return ERROR;
+        }
+        n += r;
+        index += gap + 1;
+        if (index >= N_TEAMS * N_SPACESHIPS) {
+            return ERROR;
+        }
+        i = index / N_SPACESHIPS;
+        j = index % N_SPACESHIPS;
+        spaceship = &next[i][j];
+        fields = buf[n++];
+        if (fields & FIELD_POSX) {
+            if (!(r = frame_get_varint(buf + n, len - n, &value))) {
+                return ERROR;
+            }
+            spaceship->posx += unzigzag(value);
+            n += r;
+        }
+        if (fields & FIELD_POSY) {
+            if (!(r = frame_get_varint(buf + n, len - n, &value))) {
+                return ERROR;
+            }
+            spaceship->posy += unzigzag(value);
+            n += r;
+        }
+        if (fields & FIELD_HEALTH) {
+            if (!(r = frame_get_varint(buf + n, len - n, &value))) {
+                return ERROR;
+            }
+            spaceship->health += unzigzag(value);
+            n += r;
+        }
+        spaceship->alive = (fields & FLAG_ALIVE) != 0;
+        if (!on_map(spaceship)) {
+            return ERROR;
+        }
+        moved[i][j] = true;
+    }
+    place_spaceships(map, next, moved);
+
+    return OK;
+}
+
+static unsigned int zigzag(int value)
+{
+    return ((unsigned int)value << 1) ^ (unsigned int)(value >> 31);
+}
+
+static int unzigzag(unsigned int value)
+{
+    return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+/* A position read from a frame must be checked before its squares are
+ * touched. */
+static bool on_map(spaceship_t* spaceship)
+{
+    return spaceship->posy >= 0 && spaceship->posy < MAP_MAX_Y &&
+           spaceship->posx >= 0 && spaceship->posx < MAP_MAX_X;
+}
+
+static void place_spaceships(map_t* map,
+                             spaceship_t next[N_TEAMS][N_SPACESHIPS],
+                             bool moved[N_TEAMS][N_SPACESHIPS])
+{
+    int i, j, alive;
+    spaceship_t old;
+    square_t square;
+
+    // Free the squares left behind by the spaceships that changed
+    for (i = 0; i < N_TEAMS; i++) {
+        for (j = 0; j < N_SPACESHIPS; j++) {
+            old = map_get_spaceship(map, i, j);
+            if (!moved[i][j] || !old.alive) {
+                continue;
+            }
+            square = map_get_square(map, old.posy, old.posx);
+            if (square.team == i && square.id_spaceship == j) {
+                map_clean_square(map, old.posy, old.posx);
+            }
+        }
+    }
+
+    // Destroyed spaceships first, so they cannot clean an occupied square
+    for (i = 0; i < N_TEAMS; i++) {
+        for (j = 0; j < N_SPACESHIPS; j++) {
+            if (moved[i][j] && !next[i][j].alive) {
+                map_set_spaceship(map, next[i][j]);
+            }
+        }
+    }
+
+    for (i = 0; i < N_TEAMS; i++) {
+        for (j = 0, alive = 0; j < N_SPACESHIPS; j++) {
+            if (moved[i][j] && next[i][j].alive) {
+                map_set_spaceship(map, next[i][j]);
+            }
+            if (next[i][j].alive) {
+                alive++;
+            }
+        }
+        map_set_num_spaceships(map, i, alive);
+    }
+    map_restore(map);
+}
@@ -0,0 +1,335 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "game.h"
+#include "kinetic.h"
+#include "map.h"
+
+static void formation_offset(formation_t formation, int j, int* dy, int* dx);
+
+// Difference array of the damage of the blasts, all zeros between turns
+static int blast_damage[MAP_MAX_Y + 1][MAP_MAX_X + 1];
+// Empty squares left for random placement, too big for the stack of large maps
+static int free_squares[MAP_MAX_Y * MAP_MAX_X];
+
+void game_init_map(map_t* map, scenario_t* scenario, unsigned int* seed)
+{
+    int i, j, k;
+    int posx, posy, dx, dy, bit;
+    int n_free = 0;
+    int n_placed[N_TEAMS] = { 0 };
+    bool placed[N_TEAMS][N_SPACESHIPS] = { { false } };
+    spaceship_t spaceship = { 0 };
+
+    map->height = scenario ? scenario->height : MAP_MAX_Y;
+    map->width = scenario ? scenario->width : MAP_MAX_X;
+
+    // The map may hold a previous match. Every spaceship starts destroyed,
+    // so the ones left without a square are not those of that match.
+    for (i = 0; i < N_TEAMS; i++) {
+        for (j = 0; j < N_SPACESHIPS; j++) {
+            spaceship.team = i;
+            spaceship.id = j;
+            map_set_spaceship(map, spaceship);
+        }
+    }
+
+    // Clean the map and lay the terrain
+    for (i = 0; i < MAP_MAX_Y; i++) {
+        for (j = 0; j < MAP_MAX_X; j++) {
+            map_clean_square(map, i, j);
+            bit = i * MAP_MAX_X + j;
+            if (scenario && (scenario->asteroids[bit / 64] >> (bit % 64)) & 1) {
+                map_set_asteroid(map, i, j);
+            }
+        }
+    }
+
+    spaceship.health = MAX_LIFE_SPACESHIPS;
+    spaceship.alive = true;
+
+    // Formations first. A spaceship whose square is taken or out of the map
+    // is placed at random with the others.
+    for (i = 0; scenario && i < N_TEAMS; i++) {
+        if (scenario->formation[i] == FORMATION_RANDOM) {
+            continue;
+        }
+        for (j = 0; j < N_SPACESHIPS; j++) {
+            formation_offset(scenario->formation[i], j, &dy, &dx);
+            posy = scenario->posy[i] + dy;
+            posx = scenario->posx[i] + dx;
+            if (posy < 0 || posy >= MAP_MAX_Y || posx < 0 ||
+                posx >= MAP_MAX_X || !map_is_square_empty(map, posy, posx)) {
+                continue;
+            }
+            spaceship.team = i;
+            spaceship.id = j;
+            spaceship.posx = posx;
+            spaceship.posy = posy;
+            map_set_spaceship(map, spaceship);
+            placed[i][j] = true;
+            n_placed[i]++;
+        }
+    }
+
+    // Each random spaceship takes a random square of the free list and the
+    // last one fills the hole, so a draw never fails however full the map is
+    for (i = 0; i < MAP_MAX_Y; i++) {
+        for (j = 0; j < MAP_MAX_X; j++) {
+            if (map_is_square_empty(map, i, j)) {
+                free_squares[n_free++] = i * MAP_MAX_X + j;
+            }
+        }
+    }
+    for (i = 0; i < N_TEAMS; i++) {
+        for (j = 0; j < N_SPACESHIPS && n_free > 0; j++) {
+            if (placed[i][j]) {
+                continue;
+            }
+            k = rand_r(seed) % n_free;
+            spaceship.team = i;
+            spaceship.id = j;
+            spaceship.posy = free_squares[k] / MAP_MAX_X;
+            spaceship.posx = free_squares[k] % MAP_MAX_X;
+            free_squares[k] = free_squares[--n_free];
+            map_set_spaceship(map, spaceship);
+            n_placed[i]++;
+        }
+    }
+    // With a full map some spaceships are left out
+    for (i = 0; i < N_TEAMS; i++) {
+        map_set_num_spaceships(map, i, n_placed[i]);
+    }
+    // The squares of a new map are garbage, so the hash starts from scratch
+    map->hash = map_compute_hash(map);
+    if (map->continuous) {
+        kinetic_init(map);
+    }
+}
+
+outcome_t game_process_move(map_t* map, move_t move, spaceship_t* target)
+{
+    square_t square;
+    spaceship_t attacked_spaceship, spaceship;
+
+    if (move.team < 0 || move.team >= N_TEAMS || move.id_spaceship < 0 ||
+        move.id_spaceship >= N_SPACESHIPS || move.objetiveX < 0 ||
+        move.objetiveX >= MAP_MAX_X || move.objetiveY < 0 ||
+        move.objetiveY >= MAP_MAX_Y) {
+        return OUTCOME_INVALID;
+    }
+
+    spaceship = map_get_spaceship(map, move.team, move.id_spaceship);
+    if (!spaceship.alive) {
+        // The spaceship die before it move
+        return OUTCOME_INVALID;
+    }
+
+    switch (move.type) {
+        case MOVE:
+            // With continuous movement THRUST replaces it
+            if (map->continuous) {
+                return OUTCOME_INVALID;
+            }
+            if (!map_is_square_empty(map, move.objetiveY, move.objetiveX)) {
+                return OUTCOME_BLOCKED;
+            }
+            map_clean_square(map, spaceship.posy, spaceship.posx);
+            spaceship.posx = move.objetiveX;
+            spaceship.posy = move.objetiveY;
+            map_set_spaceship(map, spaceship);
+            return OUTCOME_MOVED;
+        case ATTACK:
+            square = map_get_square(map, move.objetiveY, move.objetiveX);
+            if (map_is_square_empty(map, move.objetiveY, move.objetiveX)) {
+                map_set_symbol(map, move.objetiveY, move.objetiveX, SYMB_WATER);
+                return OUTCOME_MISSED;
+            }
+            // The missile breaks on the asteroid
+            if (square.team == TEAM_ASTEROID) {
+                return OUTCOME_MISSED;
+            }
+            attacked_spaceship =
+              map_get_spaceship(map, square.team, square.id_spaceship);
+            if (!attacked_spaceship.alive) {
+                map_set_symbol(map, move.objetiveY, move.objetiveX, SYMB_WATER);
+                return OUTCOME_MISSED;
+            }
+            attacked_spaceship.health -= ATACK_DAMAGE;
+            if (attacked_spaceship.health <= 0) {
+                map_set_symbol(
+                  map, move.objetiveY, move.objetiveX, SYMB_DESTROYED);
+                map_set_num_spaceships(
+                  map,
+                  attacked_spaceship.team,
+                  map_get_num_spaceships(map, attacked_spaceship.team) - 1);
+                attacked_spaceship.alive = false;
+                attacked_spaceship.health = 0;
+                map_set_spaceship(map, attacked_spaceship);
+                *target = attacked_spaceship;
+                return OUTCOME_DESTROYED;
+            }
+            map_set_symbol(map, move.objetiveY, move.objetiveX, SYMB_DAMAGED);
+            map_set_spaceship(map, attacked_spaceship);
+            *target = attacked_spaceship;
+            return OUTCOME_DAMAGED;
+        case SPLASH:
+            if (!map->splash) {
+                return OUTCOME_INVALID;
+            }
+            return OUTCOME_LAUNCHED;
+        case THRUST:
+            if (!map->continuous) {
+                return OUTCOME_INVALID;
+            }
+            kinetic_thrust(map, move);
+            return OUTCOME_THRUST;
+    }
+
+    return OUTCOME_INVALID;
+}
+
+void game_add_blast(blasts_t* blasts, move_t move)
+{
+    if (blasts->n < GAME_MAX_BLASTS) {
+        blasts->posy[blasts->n] = move.objetiveY;
+        blasts->posx[blasts->n] = move.objetiveX;
+        blasts->team[blasts->n] = move.team;
+        blasts->n++;
+    }
+}
+
+int game_resolve_blasts(map_t* map,
+                        blasts_t* blasts,
+                        spaceship_t victims[N_TEAMS * N_SPACESHIPS])
+{
+    int i, j, k, n_hit = 0, n_victims = 0;
+    int miny, maxy, minx, maxx;
+    int top = MAP_MAX_Y, bottom = 0, left = MAP_MAX_X, right = 0;
+    spaceship_t spaceship;
+
+    if (!blasts->n) {
+        return 0;
+    }
+    map_update_occupancy(map);
+
+    // The four corners of the square of each blast that hits someone
+    for (k = 0; k < blasts->n; k++) {
+        for (i = 0, j = 0; i < N_TEAMS; i++) {
+            j += map_count_spaceships(
+              map, i, blasts->posy[k], blasts->posx[k], SPLASH_RADIUS);
+        }
+        if (!j) {
+            continue;
+        }
+        miny = blasts->posy[k] - SPLASH_RADIUS;
+        maxy = blasts->posy[k] + SPLASH_RADIUS + 1;
+        minx = blasts->posx[k] - SPLASH_RADIUS;
+        maxx = blasts->posx[k] + SPLASH_RADIUS + 1;
+        miny = (miny < 0) ? 0 : miny;
+        minx = (minx < 0) ? 0 : minx;
+        maxy = (maxy > MAP_MAX_Y) ? MAP_MAX_Y : maxy;
+        maxx = (maxx > MAP_MAX_X) ? MAP_MAX_X : maxx;
+        blast_damage[miny][minx] += SPLASH_DAMAGE;
+        blast_damage[miny][maxx] -= SPLASH_DAMAGE;
+        blast_damage[maxy][minx] -= SPLASH_DAMAGE;
+        blast_damage[maxy][maxx] += SPLASH_DAMAGE;
+        top = (miny < top) ? miny : top;
+        bottom = (maxy > bottom) ? maxy : bottom;
+        left = (minx < left) ? minx : left;
+        right = (maxx > right) ? maxx : right;
+        n_hit++;
+    }
+    blasts->n = 0;
+    if (!n_hit) {
+        return 0;
+    }
+
+    // Outside the box of the blasts the array is zero, so the prefix sum
+    // can start at its corner
+    for (i = top; i < bottom; i++) {
+        for (j = left + 1; j < right; j++) {
+            blast_damage[i][j] += blast_damage[i][j - 1];
+        }
+    }
+    for (i = top + 1; i < bottom; i++) {
+        for (j = left; j < right; j++) {
+            blast_damage[i][j] += blast_damage[i - 1][j];
+        }
+    }
+
+    for (i = 0; i < N_TEAMS; i++) {
+        for (j = 0; j < N_SPACESHIPS; j++) {
+            spaceship = map_get_spaceship(map, i, j);
+            if (!spaceship.alive || spaceship.posy < top ||
+                spaceship.posy >= bottom || spaceship.posx < left ||
+                spaceship.posx >= right ||
+                !blast_damage[spaceship.posy][spaceship.posx]) {
+                continue;
+            }
+            spaceship.health -= blast_damage[spaceship.posy][spaceship.posx];
+            if (spaceship.health <= 0) {
+                spaceship.health = 0;
+                spaceship.alive = false;
+                map_set_num_spaceships(
+                  map, i, map_get_num_spaceships(map, i) - 1);
+            }
+            map_set_spaceship(map, spaceship);
+            victims[n_victims++] = spaceship;
+        }
+    }
+
+    // Left as zeros for the next turn, the corners below and to the right
+    // of the box included
+    for (i = top; i <= bottom; i++) {
+        for (j = left; j <= right; j++) {
+            blast_damage[i][j] = 0;
+        }
+    }
+
+    return n_victims;
+}
+
+int game_get_winner(map_t* map)
+{
+    int i;
+    int teams_alive, winner = N_TEAMS;
+
+    for (i = 0, teams_alive = 0; i < N_TEAMS; i++) {
+        if (map_get_num_spaceships(map, i)) {
+            teams_alive++;
+            winner = i;
+        }
+    }
+
+    return (teams_alive > 1) ? -1 : winner;
+}
+
+/* Square of the spaceship j of a formation relative to its anchor. */
+static void formation_offset(formation_t formation, int j, int* dy, int* dx)
+{
+    int side;
+
+    *dy = *dx = 0;
+    switch (formation) {
+        case FORMATION_LINE:
+            *dx = j - N_SPACESHIPS / 2;
+            break;
+        case FORMATION_COLUMN:
+            *dy = j - N_SPACESHIPS / 2;
+            break;
+        case FORMATION_BLOCK:
+            for (side = 1; side * side < N_SPACESHIPS; side++) {
+            }
+            *dy = j / side - side / 2;
+            *dx = j % side - side / 2;
+            break;
+        case FORMATION_WEDGE:
+            // Odd spaceships to the left and even ones to the right
+            *dy = (j + 1) / 2;
+            *dx = (j % 2) ? -*dy : *dy;
+            break;
+        default:
+            break;
+    }
+}
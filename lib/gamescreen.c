@@ -6,7 +6,8 @@ void screen_init()
     clear();
     noecho();
     cbreak();
-    keypad(stdscr, FALSE);
+    keypad(stdscr, TRUE);
+    nodelay(stdscr, TRUE);
     curs_set(0);
 }
 
@@ -15,6 +16,41 @@ void screen_addch(int row, int col, char symbol)
     mvaddch(row, col, symbol);
 }
 
+void screen_addstr(int row, int col, const char* str)
+{
+    mvaddstr(row, col, str);
+}
+
+void screen_clear()
+{
+    erase();
+}
+
+void screen_size(int* rows, int* cols)
+{
+    getmaxyx(stdscr, *rows, *cols);
+}
+
+int screen_getch()
+{
+    int c = getch();
+
+    switch (c) {
+        case KEY_LEFT:
+            return 'h';
+        case KEY_DOWN:
+            return 'j';
+        case KEY_UP:
+            return 'k';
+        case KEY_RIGHT:
+            return 'l';
+        case ERR:
+            return -1;
+    }
+
+    return c;
+}
+
 void screen_refresh()
 {
     refresh();
@@ -0,0 +1,100 @@
+#include <ctype.h>
+#include <errno.h>
+#include <mqueue.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "ipc.h"
+#include "shm.h"
+
+static void build_name(char* name, const char* base, const char* instance);
+
+status ipc_names_init(ipc_names_t* names, const char* instance)
+{
+    const char* c;
+    char base[IPC_MAX_NAME];
+    int i;
+
+    memset(names, 0, sizeof(ipc_names_t));
+    if (!instance) {
+        instance = "";
+    }
+    if (strlen(instance) > IPC_MAX_INSTANCE) {
+        return ERROR;
+    }
+    for (c = instance; *c; c++) {
+        if (!isalnum((unsigned char)*c) && *c != '-' && *c != '_') {
+            return ERROR;
+        }
+    }
+    strcpy(names->instance, instance);
+
+    build_name(names->shm_map, SHM_MAP_NAME, instance);
+    build_name(names->shm_rewind, SHM_REWIND_NAME, instance);
+    build_name(names->shm_snapshot, SHM_SNAPSHOT_NAME, instance);
+    for (i = 0; i < N_TEAMS; i++) {
+        snprintf(base, sizeof(base), "%s_%d", MQ_ACTION_NAME, i);
+        build_name(names->mq_actions[i], base, instance);
+    }
+    build_name(names->sem_count_r, SEM_COUNT_R_NAME, instance);
+    build_name(names->sem_mutex, SEM_MUTEX_R_NAME, instance);
+    build_name(names->sem_w, SEM_W_NAME, instance);
+    build_name(names->sem_r, SEM_R_NAME, instance);
+    build_name(names->sem_ready, SEM_READY_NAME, instance);
+
+    return OK;
+}
+
+status ipc_reclaim(ipc_names_t* names)
+{
+    shm_region_t region;
+    pid_t owner;
+
+    // The map is created first and removed last, so without it there is no
+    // simulator and anything left can go
+    if (shm_region_attach(
+          &region, names->shm_map, sizeof(map_t), PROT_READ, 0)) {
+        owner = ((map_t*)region.addr)->owner;
+        if (owner > 0 && (kill(owner, 0) == 0 || errno == EPERM)) {
+            shm_region_detach(&region);
+            return ERROR;
+        }
+        fprintf(stdout,
+                "[IPC] Reclaiming the resources of the dead simulator %d...\n",
+                (int)owner);
+        shm_region_destroy(&region, names->shm_map);
+    } else {
+        shm_region_detach(&region);
+    }
+    ipc_unlink(names);
+
+    return OK;
+}
+
+void ipc_unlink(ipc_names_t* names)
+{
+    int i;
+
+    for (i = 0; i < N_TEAMS; i++) {
+        mq_unlink(names->mq_actions[i]);
+    }
+    shm_unlink(names->shm_rewind);
+    shm_unlink(names->shm_snapshot);
+    sem_unlink(names->sem_count_r);
+    sem_unlink(names->sem_mutex);
+    sem_unlink(names->sem_w);
+    sem_unlink(names->sem_r);
+    sem_unlink(names->sem_ready);
+}
+
+static void build_name(char* name, const char* base, const char* instance)
+{
+    if (*instance) {
+        snprintf(name, IPC_MAX_NAME, "%s.%s", base, instance);
+    } else {
+        snprintf(name, IPC_MAX_NAME, "%s", base);
+    }
+}
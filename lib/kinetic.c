@@ -0,0 +1,183 @@
+#include <string.h>
+
+#include "kinetic.h"
+#include "map.h"
+
+#define KINETIC_DT (1.0f / KINETIC_STEPS)
+#define KINETIC_EDGE 0.001f // Keeps positions inside the last square
+
+// GCC vector types, lowered to the SIMD instructions of the target
+typedef float kinetic_vec_t
+  __attribute__((vector_size(KINETIC_LANES * sizeof(float))));
+typedef int kinetic_mask_t
+  __attribute__((vector_size(KINETIC_LANES * sizeof(int))));
+
+static void place(map_t* map, spaceship_t spaceship);
+static void integrate(kinetic_t* kinetic, float* nextx, float* nexty);
+static void advance_lanes(const float* pos,
+                          float* vel,
+                          const float* acc,
+                          float* next,
+                          int size);
+static kinetic_vec_t clamp(kinetic_vec_t value, float min, float max);
+static bool enter(map_t* map, spaceship_t* spaceship, float posy, float posx);
+
+void kinetic_init(map_t* map)
+{
+    int i, j;
+
+    memset(&map->kinetic, 0, sizeof(map->kinetic));
+    for (i = 0; i < N_TEAMS; i++) {
+        for (j = 0; j < N_SPACESHIPS; j++) {
+            place(map, map_get_spaceship(map, i, j));
+        }
+    }
+}
+
+void kinetic_thrust(map_t* map, move_t move)
+{
+    int i = move.team * N_SPACESHIPS + move.id_spaceship;
+    float max = KINETIC_MAX_THRUST;
+
+    // Also false for NaN
+    if (!(move.thrustx >= -max && move.thrustx <= max)) {
+        move.thrustx = (move.thrustx > 0)   ? max
+                       : (move.thrustx < 0) ? -max
+                                            : 0;
+    }
+    if (!(move.thrusty >= -max && move.thrusty <= max)) {
+        move.thrusty = (move.thrusty > 0)   ? max
+                       : (move.thrusty < 0) ? -max
+                                            : 0;
+    }
+    map->kinetic.accx[i] = move.thrustx;
+    map->kinetic.accy[i] = move.thrusty;
+}
+
+int kinetic_advance(map_t* map)
+{
+    int i, j, k, step, moved = 0;
+    kinetic_t* kinetic = &map->kinetic;
+    spaceship_t spaceship, old;
+    float nextx[KINETIC_N];
+    float nexty[KINETIC_N];
+
+    for (step = 0; step < KINETIC_STEPS; step++) {
+        integrate(kinetic, nextx, nexty);
+
+        // A step is at most KINETIC_MAX_SPEED / KINETIC_STEPS squares, less
+        // than one, so no square is jumped over
+        for (i = 0; i < N_TEAMS; i++) {
+            for (j = 0; j < N_SPACESHIPS; j++) {
+                k = i * N_SPACESHIPS + j;
+                old = spaceship = map_get_spaceship(map, i, j);
+                if (!spaceship.alive) {
+                    continue;
+                }
+                if (enter(map, &spaceship, nexty[k], nextx[k])) {
+                    kinetic->posx[k] = nextx[k];
+                    kinetic->posy[k] = nexty[k];
+                } else if (enter(
+                             map, &spaceship, kinetic->posy[k], nextx[k])) {
+                    kinetic->posx[k] = nextx[k];
+                    kinetic->vely[k] = 0;
+                } else if (enter(
+                             map, &spaceship, nexty[k], kinetic->posx[k])) {
+                    kinetic->posy[k] = nexty[k];
+                    kinetic->velx[k] = 0;
+                } else {
+                    kinetic->velx[k] = kinetic->vely[k] = 0;
+                }
+                if (spaceship.posy != old.posy || spaceship.posx != old.posx) {
+                    map_clean_square(map, old.posy, old.posx);
+                    map_set_spaceship(map, spaceship);
+                    moved++;
+                }
+            }
+        }
+    }
+    memset(kinetic->accx, 0, sizeof(kinetic->accx));
+    memset(kinetic->accy, 0, sizeof(kinetic->accy));
+
+    return moved;
+}
+
+/* Puts the spaceship still in the center of its square. */
+static void place(map_t* map, spaceship_t spaceship)
+{
+    int i = spaceship.team * N_SPACESHIPS + spaceship.id;
+    kinetic_t* kinetic = &map->kinetic;
+
+    kinetic->posx[i] = spaceship.posx + 0.5f;
+    kinetic->posy[i] = spaceship.posy + 0.5f;
+    kinetic->velx[i] = kinetic->vely[i] = 0;
+    kinetic->accx[i] = kinetic->accy[i] = 0;
+}
+
+/* One step of semi-implicit Euler for every lane, dead spaceships and
+ * padding included, KINETIC_LANES at a time. */
+static void integrate(kinetic_t* kinetic, float* nextx, float* nexty)
+{
+    int i;
+
+    for (i = 0; i < KINETIC_N; i += KINETIC_LANES) {
+        advance_lanes(&kinetic->posx[i],
+                      &kinetic->velx[i],
+                      &kinetic->accx[i],
+                      &nextx[i],
+                      MAP_MAX_X);
+        advance_lanes(&kinetic->posy[i],
+                      &kinetic->vely[i],
+                      &kinetic->accy[i],
+                      &nexty[i],
+                      MAP_MAX_Y);
+    }
+}
+
+/* Velocity and next position of one axis of KINETIC_LANES spaceships,
+ * clamped to the speed limit and to the map of that size. */
+static void advance_lanes(const float* pos,
+                          float* vel,
+                          const float* acc,
+                          float* next,
+                          int size)
+{
+    kinetic_vec_t p, v, a;
+
+    memcpy(&p, pos, sizeof(p));
+    memcpy(&v, vel, sizeof(v));
+    memcpy(&a, acc, sizeof(a));
+    v = clamp(v + a * KINETIC_DT, -KINETIC_MAX_SPEED, KINETIC_MAX_SPEED);
+    p = clamp(p + v * KINETIC_DT, 0, size - KINETIC_EDGE);
+    memcpy(vel, &v, sizeof(v));
+    memcpy(next, &p, sizeof(p));
+}
+
+/* Selects with masks instead of branches, lane by lane. */
+static kinetic_vec_t clamp(kinetic_vec_t value, float min, float max)
+{
+    kinetic_mask_t below = value < min;
+    kinetic_mask_t above = value > max;
+    kinetic_mask_t bits = (kinetic_mask_t)value & ~below & ~above;
+
+    bits |= ((kinetic_mask_t)(value * 0 + min) & below) |
+            ((kinetic_mask_t)(value * 0 + max) & above);
+
+    return (kinetic_vec_t)bits;
+}
+
+/* True if the spaceship can be at the position: its own square or an empty
+ * one. Leaves that square in spaceship. */
+static bool enter(map_t* map, spaceship_t* spaceship, float posy, float posx)
+{
+    int y = (int)posy, x = (int)posx;
+
+    if ((y != spaceship->posy || x != spaceship->posx) &&
+        !map_is_square_empty(map, y, x)) {
+        return false;
+    }
+    spaceship->posy = y;
+    spaceship->posx = x;
+
+    return true;
+}
@@ -0,0 +1,129 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lod.h"
+
+extern char team_symbols[N_TEAMS];
+
+static void add_spaceship(lod_t* lod, spaceship_t spaceship, int sign);
+
+status lod_init(lod_t* lod)
+{
+    int l, width = MAP_MAX_X, height = MAP_MAX_Y;
+
+    memset(lod, 0, sizeof(lod_t));
+    for (l = 0; l < LOD_MAX_LEVELS; l++) {
+        lod->width[l] = width;
+        lod->height[l] = height;
+        lod->cells[l] = calloc(width * height, sizeof(lod_cell_t));
+        if (!lod->cells[l]) {
+            lod_free(lod);
+            return ERROR;
+        }
+        lod->n_levels++;
+        if (width == 1 && height == 1) {
+            break;
+        }
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+
+    return OK;
+}
+
+void lod_free(lod_t* lod)
+{
+    int l;
+
+    for (l = 0; l < lod->n_levels; l++) {
+        free(lod->cells[l]);
+        lod->cells[l] = NULL;
+    }
+    lod->n_levels = 0;
+}
+
+void lod_update(lod_t* lod, map_t* map)
+{
+    int i, j;
+    spaceship_t spaceship, *last;
+
+    for (i = 0; i < N_TEAMS; i++) {
+        for (j = 0; j < N_SPACESHIPS; j++) {
+            // Copy first, the map may change while we read it
+            spaceship = map->spaceships[i][j];
+            last = &lod->last[i][j];
+            if (spaceship.alive == last->alive &&
+                spaceship.posx == last->posx &&
+                spaceship.posy == last->posy &&
+                spaceship.health == last->health) {
+                continue;
+            }
+            add_spaceship(lod, *last, -1);
+            add_spaceship(lod, spaceship, 1);
+            *last = spaceship;
+        }
+    }
+}
+
+lod_cell_t lod_get(lod_t* lod, int level, int row, int col)
+{
+    return lod->cells[level][row * lod->width[level] + col];
+}
+
+char lod_symbol(lod_cell_t cell)
+{
+    int i, total = 0, fighting = 0;
+    int dominant = -1, best = 0;
+    bool tie = false;
+
+    for (i = 0; i < N_TEAMS; i++) {
+        total += cell.count[i];
+        if (cell.damaged[i]) {
+            fighting++;
+        }
+        if (cell.count[i] > best) {
+            best = cell.count[i];
+            dominant = i;
+            tie = false;
+        } else if (cell.count[i] && cell.count[i] == best) {
+            tie = true;
+        }
+    }
+
+    if (total == 0) {
+        return SYMB_EMPTY;
+    }
+    if (fighting > 1) {
+        return LOD_SYMB_FIGHT;
+    }
+    if (tie) {
+        return LOD_SYMB_TIE;
+    }
+
+    return (best == 1) ? tolower(team_symbols[dominant])
+                       : team_symbols[dominant];
+}
+
+static void add_spaceship(lod_t* lod, spaceship_t spaceship, int sign)
+{
+    int l;
+    lod_cell_t* cell;
+
+    // A torn read of the map could give a position out of it
+    if (!spaceship.alive || spaceship.team < 0 || spaceship.team >= N_TEAMS ||
+        spaceship.posx < 0 || spaceship.posx >= MAP_MAX_X ||
+        spaceship.posy < 0 || spaceship.posy >= MAP_MAX_Y) {
+        return;
+    }
+
+    for (l = 0; l < lod->n_levels; l++) {
+        cell = &lod->cells[l][(spaceship.posy >> l) * lod->width[l] +
+                              (spaceship.posx >> l)];
+        cell->count[spaceship.team] += sign;
+        if (spaceship.health < MAX_LIFE_SPACESHIPS) {
+            cell->damaged[spaceship.team] += sign;
+        }
+    }
+}
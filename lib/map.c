@@ -1,22 +1,116 @@
 #include <math.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "map.h"
 
 char team_symbols[N_TEAMS] = { 'A', 'B', 'C' };
 
+static const square_t empty_square = { SYMB_EMPTY, -1, -1 };
+
+/* Kernels that only visit the playable area. The squares out of it are
+ * asteroids, which nothing changes and which add nothing to the hash. */
+typedef struct {
+    int height;
+    int width;
+    void (*restore)(map_t* map);
+    uint64_t (*squares_hash)(map_t* map);
+    void (*send_missil)(map_t* map, int oriy, int orix, int tary, int tarx);
+} map_kernels_t;
+
+static inline void restore_area(map_t* map, int height, int width);
+static inline uint64_t squares_hash_area(map_t* map, int height, int width);
+static inline void send_missil_area(map_t* map,
+                                    int height,
+                                    int originy,
+                                    int originx,
+                                    int targety,
+                                    int targetx);
+static void restore_generic(map_t* map);
+static uint64_t squares_hash_generic(map_t* map);
+static void send_missil_generic(map_t* map,
+                                int originy,
+                                int originx,
+                                int targety,
+                                int targetx);
+
+// One set of kernels per geometry, with the bounds as constants so the
+// compiler can unroll and vectorize the loops
+#define MAP_KERNELS(H, W)                                                    \
+    _Static_assert((H) > 0 && (H) <= MAP_MAX_Y && (W) > 0 &&                 \
+                     (W) <= MAP_MAX_X,                                       \
+                   "geometry out of the map");                               \
+    static void restore_##H##x##W(map_t* map)                                \
+    {                                                                        \
+        restore_area(map, H, W);                                             \
+    }                                                                        \
+    static uint64_t squares_hash_##H##x##W(map_t* map)                       \
+    {                                                                        \
+        return squares_hash_area(map, H, W);                                 \
+    }                                                                        \
+    static void send_missil_##H##x##W(                                       \
+      map_t* map, int oriy, int orix, int tary, int tarx)                    \
+    {                                                                        \
+        send_missil_area(map, H, oriy, orix, tary, tarx);                    \
+    }
+MAP_GEOMETRIES(MAP_KERNELS)
+
+#define MAP_KERNELS_ENTRY(H, W)                                              \
+    { H, W, restore_##H##x##W, squares_hash_##H##x##W, send_missil_##H##x##W },
+static const map_kernels_t fixed_kernels[] = {
+    MAP_GEOMETRIES(MAP_KERNELS_ENTRY)
+};
+
+// Any other area, with the bounds read at run time
+static map_kernels_t generic_kernels = {
+    MAP_MAX_Y, MAP_MAX_X, restore_generic, squares_hash_generic,
+    send_missil_generic
+};
+
+// The first geometry is the whole map, used until an area is chosen
+static const map_kernels_t* kernels = &fixed_kernels[0];
+
+static square_t map_read(map_t* map, int posy, int posx);
+static void map_write(map_t* map, int posy, int posx, square_t square);
+static void map_add_influence(map_t* map, spaceship_t spaceship, int sign);
+static void map_add_vision(map_t* map, spaceship_t spaceship, int sign);
+static uint64_t map_mix(uint64_t value);
+static uint64_t map_spaceship_key(spaceship_t spaceship);
+static uint64_t map_square_key(int posy, int posx, square_t square);
+
 void map_clean_square(map_t* map, int posy, int posx)
 {
-    map->squares[posy][posx].team = -1;
-    map->squares[posy][posx].id_spaceship = -1;
-    map->squares[posy][posx].symbol = SYMB_EMPTY;
+    int bit = posy * MAP_MAX_X + posx;
+
+    map->hash ^= map_square_key(posy, posx, map_read(map, posy, posx));
+    map_write(map, posy, posx, empty_square);
+    map->terrain[bit / 64] &= ~(1ULL << (bit % 64));
+}
+
+void map_set_asteroid(map_t* map, int posy, int posx)
+{
+    int bit = posy * MAP_MAX_X + posx;
+    square_t square = { SYMB_ASTEROID, TEAM_ASTEROID, -1 };
+
+    // The terrain does not change during a match, so it is not hashed
+    map_write(map, posy, posx, square);
+    map->terrain[bit / 64] |= 1ULL << (bit % 64);
+}
+
+bool map_is_asteroid(map_t* map, int posy, int posx)
+{
+    int bit = posy * MAP_MAX_X + posx;
+
+    return (map->terrain[bit / 64] >> (bit % 64)) & 1;
 }
 
 square_t map_get_square(map_t* map, int posy, int posx)
 {
-    return map->squares[posy][posx];
+    return map_read(map, posy, posx);
 }
 
 int map_get_distance(map_t* map, int oriy, int orix, int targety, int targetx)
@@ -38,50 +132,213 @@ int map_get_num_spaceships(map_t* map, int team)
     return map->n_spaceships_alive[team];
 }
 
+int map_get_threat(map_t* map, int team, int posy, int posx)
+{
+    return map->cover_total[posy][posx] - map->cover[team][posy][posx];
+}
+
+int map_get_influence(map_t* map, int team, int posy, int posx)
+{
+    return 2 * map->strength[team][posy][posx] -
+           map->strength_total[posy][posx];
+}
+
+void map_update_occupancy(map_t* map)
+{
+    int i, j, k;
+    spaceship_t spaceship;
+    unsigned short(*occupancy)[MAP_MAX_X + 1];
+
+    for (k = 0; k < N_TEAMS; k++) {
+        occupancy = map->occupancy[k];
+        memset(occupancy, 0, sizeof(map->occupancy[k]));
+        for (j = 0; j < N_SPACESHIPS; j++) {
+            spaceship = map->spaceships[k][j];
+            if (spaceship.alive) {
+                occupancy[spaceship.posy + 1][spaceship.posx + 1]++;
+            }
+        }
+        // Along the rows, then whole rows down, which can be vectorized
+        for (i = 1; i <= MAP_MAX_Y; i++) {
+            for (j = 1; j <= MAP_MAX_X; j++) {
+                occupancy[i][j] += occupancy[i][j - 1];
+            }
+        }
+        for (i = 1; i <= MAP_MAX_Y; i++) {
+            for (j = 1; j <= MAP_MAX_X; j++) {
+                occupancy[i][j] += occupancy[i - 1][j];
+            }
+        }
+    }
+}
+
+int map_count_spaceships(map_t* map, int team, int posy, int posx, int radius)
+{
+    int miny, maxy, minx, maxx;
+    unsigned short(*occupancy)[MAP_MAX_X + 1] = map->occupancy[team];
+
+    miny = (posy - radius < 0) ? 0 : posy - radius;
+    minx = (posx - radius < 0) ? 0 : posx - radius;
+    maxy = (posy + radius >= MAP_MAX_Y) ? MAP_MAX_Y : posy + radius + 1;
+    maxx = (posx + radius >= MAP_MAX_X) ? MAP_MAX_X : posx + radius + 1;
+
+    return occupancy[maxy][maxx] - occupancy[miny][maxx] -
+           occupancy[maxy][minx] + occupancy[miny][minx];
+}
+
+uint64_t map_compute_hash(map_t* map)
+{
+    int i, j;
+    uint64_t hash = 0;
+#ifdef MAP_SPARSE
+    int cy, cx, chunk;
+#endif
+
+    for (i = 0; i < N_TEAMS; i++) {
+        for (j = 0; j < N_SPACESHIPS; j++) {
+            hash ^= map_spaceship_key(map->spaceships[i][j]);
+        }
+    }
+#ifdef MAP_SPARSE
+    // Empty squares add nothing, so only the chunks in use are read
+    for (cy = 0; cy < MAP_CHUNKS_Y; cy++) {
+        for (cx = 0; cx < MAP_CHUNKS_X; cx++) {
+            chunk = map->chunk_dir[cy][cx] - 1;
+            for (i = 0; chunk >= 0 && i < MAP_CHUNK_SIZE; i++) {
+                for (j = 0; j < MAP_CHUNK_SIZE; j++) {
+                    hash ^= map_square_key((cy << MAP_CHUNK_SHIFT) + i,
+                                           (cx << MAP_CHUNK_SHIFT) + j,
+                                           map->chunks[chunk].squares[i][j]);
+                }
+            }
+        }
+    }
+#else
+    hash ^= kernels->squares_hash(map);
+#endif
+
+    return hash;
+}
+
+bool map_is_visible(map_t* map, int team, int posy, int posx)
+{
+    int bit = posy * MAP_MAX_X + posx;
+
+    return (map->visible[team][bit / 64] >> (bit % 64)) & 1;
+}
+
+square_t map_get_view(map_t* map, int team, int posy, int posx)
+{
+    square_t square = map_read(map, posy, posx);
+
+    if (square.team != TEAM_ASTEROID &&
+        !map_is_visible(map, team, posy, posx)) {
+        square.team = -1;
+        square.id_spaceship = -1;
+        square.symbol = SYMB_EMPTY;
+    }
+
+    return square;
+}
+
+void map_set_sensor_range(map_t* map, int range)
+{
+    int i, j;
+
+    memset(map->seen, 0, sizeof(map->seen));
+    memset(map->visible, 0, sizeof(map->visible));
+    map->sensor_range = range;
+    for (i = 0; i < N_TEAMS; i++) {
+        for (j = 0; j < N_SPACESHIPS; j++) {
+            map_add_vision(map, map->spaceships[i][j], 1);
+        }
+    }
+}
+
 char map_get_symbol(map_t* map, int posy, int posx)
 {
-    return map->squares[posy][posx].symbol;
+    return map_read(map, posy, posx).symbol;
 }
 
 bool map_is_square_empty(map_t* map, int posy, int posx)
 {
-    return (map->squares[posy][posx].team < 0);
+    return (map_read(map, posy, posx).team == -1);
 }
 
 void map_restore(map_t* map)
 {
-    int i, j;
+#ifdef MAP_SPARSE
+    int i, j, cy, cx;
 
-    for (j = 0; j < MAP_MAX_X; j++) {
-        for (i = 0; i < MAP_MAX_Y; i++) {
-            square_t cas = map_get_square(map, j, i);
-            if (cas.team < 0) {
-                map_set_symbol(map, j, i, SYMB_EMPTY);
-            } else {
-                map_set_symbol(map, j, i, team_symbols[cas.team]);
+    // Empty squares have no symbol to restore. A chunk left with empty
+    // squares only is freed by the last write, and the reads after it see
+    // empty squares.
+    for (cy = 0; cy < MAP_CHUNKS_Y; cy++) {
+        for (cx = 0; cx < MAP_CHUNKS_X; cx++) {
+            if (!map->chunk_dir[cy][cx]) {
+                continue;
+            }
+            for (i = cy << MAP_CHUNK_SHIFT;
+                 i < ((cy + 1) << MAP_CHUNK_SHIFT) && i < MAP_MAX_Y;
+                 i++) {
+                for (j = cx << MAP_CHUNK_SHIFT;
+                     j < ((cx + 1) << MAP_CHUNK_SHIFT) && j < MAP_MAX_X;
+                     j++) {
+                    square_t cas = map_read(map, i, j);
+                    if (cas.team == TEAM_ASTEROID) {
+                        map_set_symbol(map, i, j, SYMB_ASTEROID);
+                    } else if (cas.team < 0) {
+                        map_set_symbol(map, i, j, SYMB_EMPTY);
+                    } else {
+                        map_set_symbol(map, i, j, team_symbols[cas.team]);
+                    }
+                }
             }
         }
     }
+#else
+    kernels->restore(map);
+#endif
 }
 
 void map_set_symbol(map_t* map, int posy, int posx, char symbol)
 {
-    map->squares[posy][posx].symbol = symbol;
+    square_t square = map_read(map, posy, posx);
+
+    square.symbol = symbol;
+    map_write(map, posy, posx, square);
 }
 
 int map_set_spaceship(map_t* map, spaceship_t spaceship)
 {
+    spaceship_t old;
+    square_t square;
+
     if (spaceship.team >= N_TEAMS)
         return -1;
     if (spaceship.id >= N_SPACESHIPS)
         return -1;
+    old = map->spaceships[spaceship.team][spaceship.id];
+    if (old.alive != spaceship.alive || old.health != spaceship.health ||
+        old.posx != spaceship.posx || old.posy != spaceship.posy) {
+        map_add_influence(map, old, -1);
+        map_add_influence(map, spaceship, 1);
+        map->hash ^= map_spaceship_key(old) ^ map_spaceship_key(spaceship);
+    }
+    if (old.alive != spaceship.alive || old.posx != spaceship.posx ||
+        old.posy != spaceship.posy) {
+        map_add_vision(map, old, -1);
+        map_add_vision(map, spaceship, 1);
+    }
     map->spaceships[spaceship.team][spaceship.id] = spaceship;
     if (spaceship.alive) {
-        map->squares[spaceship.posy][spaceship.posx].team = spaceship.team;
-        map->squares[spaceship.posy][spaceship.posx].id_spaceship =
-          spaceship.id;
-        map->squares[spaceship.posy][spaceship.posx].symbol =
-          team_symbols[spaceship.team];
+        square = map_read(map, spaceship.posy, spaceship.posx);
+        map->hash ^= map_square_key(spaceship.posy, spaceship.posx, square);
+        square.team = spaceship.team;
+        square.id_spaceship = spaceship.id;
+        square.symbol = team_symbols[spaceship.team];
+        map_write(map, spaceship.posy, spaceship.posx, square);
+        map->hash ^= map_square_key(spaceship.posy, spaceship.posx, square);
     } else {
         map_clean_square(map, spaceship.posy, spaceship.posx);
     }
@@ -98,6 +355,143 @@ void map_send_missil(map_t* map,
                      int originx,
                      int targety,
                      int targetx)
+{
+    kernels->send_missil(map, originy, originx, targety, targetx);
+}
+
+bool map_set_area(int height, int width)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(fixed_kernels) / sizeof(fixed_kernels[0]); i++) {
+        if (fixed_kernels[i].height == height &&
+            fixed_kernels[i].width == width) {
+            kernels = &fixed_kernels[i];
+            return true;
+        }
+    }
+    generic_kernels.height = height;
+    generic_kernels.width = width;
+    kernels = &generic_kernels;
+
+    return false;
+}
+
+#ifdef MAP_SPARSE
+/* An empty square of a chunk not allocated reads as empty_square. */
+static square_t map_read(map_t* map, int posy, int posx)
+{
+    int chunk =
+      map->chunk_dir[posy >> MAP_CHUNK_SHIFT][posx >> MAP_CHUNK_SHIFT] - 1;
+
+    if (chunk < 0) {
+        return empty_square;
+    }
+
+    return map->chunks[chunk]
+      .squares[posy & (MAP_CHUNK_SIZE - 1)][posx & (MAP_CHUNK_SIZE - 1)];
+}
+
+/* Takes a chunk from the pool for the first square that is not empty, and
+ * gives it back when the last one is emptied. Freed chunks are reused
+ * first, so the pages touched follow the most chunks used at once. */
+static void map_write(map_t* map, int posy, int posx, square_t square)
+{
+    int i, j;
+    int* dir =
+      &map->chunk_dir[posy >> MAP_CHUNK_SHIFT][posx >> MAP_CHUNK_SHIFT];
+    map_chunk_t* chunk;
+    square_t* old;
+    bool blank = (square.team == -1 && square.symbol == SYMB_EMPTY);
+
+    if (!*dir) {
+        if (blank) {
+            return;
+        }
+        if (map->chunks_free) {
+            *dir = map->chunks_free;
+            map->chunks_free = map->chunks[*dir - 1].next;
+        } else if (map->chunks_taken < MAP_SPARSE_CHUNKS) {
+            *dir = ++map->chunks_taken;
+        } else {
+            map->chunks_full++;
+            return;
+        }
+        chunk = &map->chunks[*dir - 1];
+        for (i = 0; i < MAP_CHUNK_SIZE; i++) {
+            for (j = 0; j < MAP_CHUNK_SIZE; j++) {
+                chunk->squares[i][j] = empty_square;
+            }
+        }
+        chunk->used = 0;
+        map->chunks_used++;
+    }
+
+    chunk = &map->chunks[*dir - 1];
+    old = &chunk->squares[posy & (MAP_CHUNK_SIZE - 1)]
+                         [posx & (MAP_CHUNK_SIZE - 1)];
+    chunk->used += (old->team == -1 && old->symbol == SYMB_EMPTY) - blank;
+    *old = square;
+    if (!chunk->used) {
+        chunk->next = map->chunks_free;
+        map->chunks_free = *dir;
+        *dir = 0;
+        map->chunks_used--;
+    }
+}
+#else
+static square_t map_read(map_t* map, int posy, int posx)
+{
+    return map->squares[posy][posx];
+}
+
+static void map_write(map_t* map, int posy, int posx, square_t square)
+{
+    map->squares[posy][posx] = square;
+}
+#endif
+
+static inline void restore_area(map_t* map, int height, int width)
+{
+    int i, j;
+    square_t square;
+
+    for (i = 0; i < height; i++) {
+        for (j = 0; j < width; j++) {
+            square = map_read(map, i, j);
+            if (square.team == TEAM_ASTEROID) {
+                square.symbol = SYMB_ASTEROID;
+            } else if (square.team < 0) {
+                square.symbol = SYMB_EMPTY;
+            } else {
+                square.symbol = team_symbols[square.team];
+            }
+            map_write(map, i, j, square);
+        }
+    }
+}
+
+static inline uint64_t squares_hash_area(map_t* map, int height, int width)
+{
+    int i, j;
+    uint64_t hash = 0;
+
+    for (i = 0; i < height; i++) {
+        for (j = 0; j < width; j++) {
+            hash ^= map_square_key(i, j, map_read(map, i, j));
+        }
+    }
+
+    return hash;
+}
+
+/* The missile flies inside the rows of the area. */
+static inline void send_missil_area(map_t* map,
+                                    int height,
+                                    int originy,
+                                    int originx,
+                                    int targety,
+                                    int targetx)
 {
     int px = originx;
     int py = originy;
@@ -122,7 +516,7 @@ void map_send_missil(map_t* map,
         // round to nearest int
         nexty = (y > 0.0) ? floor(y + 0.5) : ceil(y - 0.5);
 
-        if ((nexty < 0) || (nexty >= MAP_MAX_Y)) {
+        if ((nexty < 0) || (nexty >= height)) {
             continue;
         }
         nexts = map_get_symbol(map, nexty, nextx);
@@ -136,3 +530,140 @@ void map_send_missil(map_t* map,
 
     map_set_symbol(map, py, px, ps);
 }
+
+static void restore_generic(map_t* map)
+{
+    restore_area(map, generic_kernels.height, generic_kernels.width);
+}
+
+static uint64_t squares_hash_generic(map_t* map)
+{
+    return squares_hash_area(
+      map, generic_kernels.height, generic_kernels.width);
+}
+
+static void send_missil_generic(map_t* map,
+                                int originy,
+                                int originx,
+                                int targety,
+                                int targetx)
+{
+    send_missil_area(
+      map, generic_kernels.height, originy, originx, targety, targetx);
+}
+
+/* Adds (sign 1) or removes (sign -1) a spaceship from the influence grids.
+ * Only the squares it can attack are touched, and each row is a contiguous
+ * run that the compiler can vectorize. */
+static void map_add_influence(map_t* map, spaceship_t spaceship, int sign)
+{
+    int i, j;
+    int miny, maxy, minx, maxx;
+    int health = sign * spaceship.health;
+    unsigned short* cover;
+    unsigned short* cover_total;
+    int* strength;
+    int* strength_total;
+
+    if (!spaceship.alive) {
+        return;
+    }
+
+    miny = spaceship.posy - MAX_ATACK_SCOPE;
+    maxy = spaceship.posy + MAX_ATACK_SCOPE;
+    minx = spaceship.posx - MAX_ATACK_SCOPE;
+    maxx = spaceship.posx + MAX_ATACK_SCOPE;
+    miny = (miny < 0) ? 0 : miny;
+    minx = (minx < 0) ? 0 : minx;
+    maxy = (maxy >= MAP_MAX_Y) ? MAP_MAX_Y - 1 : maxy;
+    maxx = (maxx >= MAP_MAX_X) ? MAP_MAX_X - 1 : maxx;
+
+    for (i = miny; i <= maxy; i++) {
+        cover = map->cover[spaceship.team][i];
+        cover_total = map->cover_total[i];
+        strength = map->strength[spaceship.team][i];
+        strength_total = map->strength_total[i];
+        for (j = minx; j <= maxx; j++) {
+            cover[j] += sign;
+            cover_total[j] += sign;
+            strength[j] += health;
+            strength_total[j] += health;
+        }
+    }
+}
+
+/* Adds (sign 1) or removes (sign -1) what a spaceship sees. The bit of a
+ * square only changes when the first spaceship of the team starts seeing it
+ * or the last one stops. */
+static void map_add_vision(map_t* map, spaceship_t spaceship, int sign)
+{
+    int i, j, bit;
+    int miny, maxy, minx, maxx;
+    unsigned short* seen;
+    uint64_t* visible;
+
+    if (!spaceship.alive) {
+        return;
+    }
+
+    miny = spaceship.posy - map->sensor_range;
+    maxy = spaceship.posy + map->sensor_range;
+    minx = spaceship.posx - map->sensor_range;
+    maxx = spaceship.posx + map->sensor_range;
+    miny = (miny < 0) ? 0 : miny;
+    minx = (minx < 0) ? 0 : minx;
+    maxy = (maxy >= MAP_MAX_Y) ? MAP_MAX_Y - 1 : maxy;
+    maxx = (maxx >= MAP_MAX_X) ? MAP_MAX_X - 1 : maxx;
+
+    visible = map->visible[spaceship.team];
+    for (i = miny; i <= maxy; i++) {
+        seen = map->seen[spaceship.team][i];
+        for (j = minx; j <= maxx; j++) {
+            seen[j] += sign;
+            // Only 0 <-> 1 transitions flip the bit
+            if (seen[j] == (sign > 0)) {
+                bit = i * MAP_MAX_X + j;
+                visible[bit / 64] ^= (uint64_t)1 << (bit % 64);
+            }
+        }
+    }
+}
+
+/* Finalizer of splitmix64: every input bit flips half of the output bits, so
+ * the keys of two states are unrelated even if the states are close. */
+static uint64_t map_mix(uint64_t value)
+{
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+
+    return value ^ (value >> 31);
+}
+
+/* Zobrist key of a spaceship record. Keys are computed on the fly instead of
+ * read from random tables, which would grow with the map and the health. A
+ * dead spaceship adds nothing, so a zeroed map has hash 0. */
+static uint64_t map_spaceship_key(spaceship_t spaceship)
+{
+    uint64_t key;
+
+    if (!spaceship.alive) {
+        return 0;
+    }
+    key = map_mix(spaceship.team * N_SPACESHIPS + spaceship.id);
+    key = map_mix(key ^ ((uint64_t)spaceship.posy << 32 |
+                         (uint32_t)spaceship.posx));
+
+    return map_mix(key ^ (uint32_t)spaceship.health);
+}
+
+static uint64_t map_square_key(int posy, int posx, square_t square)
+{
+    if (square.team < 0) {
+        return 0;
+    }
+
+    return map_mix(~((uint64_t)(posy * MAP_MAX_X + posx) << 32 |
+                     (uint32_t)(square.team * N_SPACESHIPS +
+                                square.id_spaceship)));
+}
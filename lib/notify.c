@@ -0,0 +1,116 @@
+#define _GNU_SOURCE // pthread_timedjoin_np
+#include <limits.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "notify.h"
+
+#define NOTIFY_JOIN_WAIT 10000000L // Nanoseconds between wake ups in close
+
+static void* wait_commits(void* arg);
+static void futex_wake(unsigned int* addr);
+
+void notify_commit(map_t* map)
+{
+    // The readers map the map read only and cannot say that they sleep, so
+    // we always wake. Without waiters it is a short system call.
+    __atomic_add_fetch(&map->commits, 1, __ATOMIC_RELEASE);
+    futex_wake(&map->commits);
+}
+
+status notify_open(notify_t* notify, map_t* map)
+{
+    sigset_t all, old;
+    int error;
+
+    notify->map = map;
+    notify->stop = 0;
+    notify->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (notify->fd == -1) {
+        return ERROR;
+    }
+    // The signals of the process are handled by the main thread
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    error = pthread_create(&notify->thread, NULL, wait_commits, notify);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (error) {
+        close(notify->fd);
+        notify->fd = -1;
+        return ERROR;
+    }
+
+    return OK;
+}
+
+unsigned long notify_clear(notify_t* notify)
+{
+    uint64_t events;
+
+    if (read(notify->fd, &events, sizeof(events)) != sizeof(events)) {
+        return 0;
+    }
+
+    return events;
+}
+
+void notify_close(notify_t* notify)
+{
+    struct timespec deadline;
+
+    if (notify->fd < 0) {
+        return;
+    }
+    // Waking needs no write access to the map. The thread may not sleep yet,
+    // so it is woken until it ends.
+    notify->stop = 1;
+    __sync_synchronize();
+    do {
+        futex_wake(&notify->map->commits);
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += NOTIFY_JOIN_WAIT;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    } while (pthread_timedjoin_np(notify->thread, NULL, &deadline) != 0);
+    close(notify->fd);
+    notify->fd = -1;
+}
+
+/* The futex only sleeps while the counter is still the one seen, so no
+ * commit between the load and the wait is lost. */
+static void* wait_commits(void* arg)
+{
+    notify_t* notify = arg;
+    unsigned int seen, now;
+    uint64_t one = 1;
+
+    seen = __atomic_load_n(&notify->map->commits, __ATOMIC_SEQ_CST);
+    while (!notify->stop) {
+        syscall(SYS_futex,
+                &notify->map->commits,
+                FUTEX_WAIT,
+                seen,
+                NULL,
+                NULL,
+                0);
+        now = __atomic_load_n(&notify->map->commits, __ATOMIC_SEQ_CST);
+        if (now != seen) {
+            seen = now;
+            write(notify->fd, &one, sizeof(one));
+        }
+    }
+
+    return NULL;
+}
+
+static void futex_wake(unsigned int* addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame.h"
+#include "map.h"
+#include "recorder.h"
+
+#define RECORD_BUFFER_SIZE (1 << 16) // stdio buffer, keeps writes off the turn
+
+static FILE* open_index(const char* path, const char* mode);
+static void fill_header(record_header_t* header, int keyframe_interval);
+static status write_frame(recorder_t* rec,
+                          int type,
+                          int turn,
+                          uint64_t hash,
+                          size_t len);
+static status read_frame(replay_t* rep, map_t* map);
+static int read_varint(FILE* f, unsigned int* value);
+
+static unsigned char frame_buffer[FRAME_MAX_SIZE];
+
+status recorder_open(recorder_t* rec, const char* path, int keyframe_interval)
+{
+    record_header_t header;
+
+    memset(rec, 0, sizeof(recorder_t));
+    rec->keyframe_interval = keyframe_interval;
+
+    rec->data = fopen(path, "wb");
+    if (!rec->data) {
+        perror("[RECORDER] Error creating the recording...\n");
+        return ERROR;
+    }
+    setvbuf(rec->data, NULL, _IOFBF, RECORD_BUFFER_SIZE);
+
+    rec->index = open_index(path, "wb");
+    if (!rec->index) {
+        perror("[RECORDER] Error creating the index...\n");
+        fclose(rec->data);
+        return ERROR;
+    }
+
+    fill_header(&header, keyframe_interval);
+    if (fwrite(&header, sizeof(header), 1, rec->data) != 1 ||
+        fwrite(&header, sizeof(header), 1, rec->index) != 1) {
+        perror("[RECORDER] Error writing the header...\n");
+        recorder_close(rec);
+        return ERROR;
+    }
+
+    return OK;
+}
+
+status recorder_write_turn(recorder_t* rec, map_t* map, int turn)
+{
+    uint64_t offset;
+    size_t len;
+    int type;
+
+    if (turn % rec->keyframe_interval == 0) {
+        offset = ftell(rec->data);
+        if (fwrite(&offset, sizeof(offset), 1, rec->index) != 1) {
+            return ERROR;
+        }
+        type = FRAME_KEY;
+        len = frame_encode_key(map->spaceships, map->terrain, frame_buffer);
+    } else {
+        type = FRAME_DELTA;
+        len = frame_encode_delta(rec->last, map->spaceships, frame_buffer);
+    }
+    memcpy(rec->last, map->spaceships, sizeof(rec->last));
+
+    return write_frame(rec, type, turn, map->hash, len);
+}
+
+void recorder_close(recorder_t* rec)
+{
+    if (rec->data) {
+        fclose(rec->data);
+        rec->data = NULL;
+    }
+    if (rec->index) {
+        fclose(rec->index);
+        rec->index = NULL;
+    }
+}
+
+status replay_open(replay_t* rep, const char* path)
+{
+    record_header_t header;
+    long size;
+
+    memset(rep, 0, sizeof(replay_t));
+    rep->turn = -1;
+    rep->diverged = -1;
+
+    rep->data = fopen(path, "rb");
+    if (!rep->data) {
+        perror("[REPLAY] Error opening the recording...\n");
+        return ERROR;
+    }
+    rep->index = open_index(path, "rb");
+    if (!rep->index) {
+        perror("[REPLAY] Error opening the index...\n");
+        replay_close(rep);
+        return ERROR;
+    }
+
+    if (fread(&rep->header, sizeof(record_header_t), 1, rep->data) != 1 ||
+        fread(&header, sizeof(header), 1, rep->index) != 1) {
+        fprintf(stderr, "[REPLAY] Truncated recording...\n");
+        replay_close(rep);
+        return ERROR;
+    }
+    fill_header(&header, rep->header.keyframe_interval);
+    if (memcmp(&header, &rep->header, sizeof(header)) != 0) {
+        fprintf(stderr,
+                "[REPLAY] The recording was made with another map geometry "
+                "or version...\n");
+        replay_close(rep);
+        return ERROR;
+    }
+
+    fseek(rep->index, 0, SEEK_END);
+    size = ftell(rep->index);
+    rep->n_keyframes = (size - sizeof(record_header_t)) / sizeof(uint64_t);
+
+    return OK;
+}
+
+status replay_seek(replay_t* rep, map_t* map, int turn)
+{
+    int keyframe;
+    uint64_t offset;
+
+    if (turn < 0) {
+        return ERROR;
+    }
+
+    // Jump to the closest keyframe unless we are already on the way
+    keyframe = turn / rep->header.keyframe_interval;
+    if (rep->turn < 0 || rep->turn > turn ||
+        rep->turn / (int)rep->header.keyframe_interval < keyframe) {
+        if (keyframe >= rep->n_keyframes) {
+            return ERROR;
+        }
+        if (fseek(rep->index,
+                  sizeof(record_header_t) + keyframe * sizeof(uint64_t),
+                  SEEK_SET) != 0 ||
+            fread(&offset, sizeof(offset), 1, rep->index) != 1 ||
+            fseek(rep->data, offset, SEEK_SET) != 0) {
+            return ERROR;
+        }
+        rep->turn = -1;
+        if (!read_frame(rep, map)) {
+            return ERROR;
+        }
+    }
+
+    while (rep->turn < turn) {
+        if (!read_frame(rep, map)) {
+            return ERROR;
+        }
+    }
+
+    return OK;
+}
+
+status replay_next(replay_t* rep, map_t* map)
+{
+    return read_frame(rep, map);
+}
+
+void replay_close(replay_t* rep)
+{
+    if (rep->data) {
+        fclose(rep->data);
+        rep->data = NULL;
+    }
+    if (rep->index) {
+        fclose(rep->index);
+        rep->index = NULL;
+    }
+}
+
+static FILE* open_index(const char* path, const char* mode)
+{
+    FILE* f;
+    char* index_path;
+
+    index_path = malloc(strlen(path) + strlen(RECORD_INDEX_SUFFIX) + 1);
+    if (!index_path) {
+        return NULL;
+    }
+    strcpy(index_path, path);
+    strcat(index_path, RECORD_INDEX_SUFFIX);
+    f = fopen(index_path, mode);
+    free(index_path);
+
+    return f;
+}
+
+static void fill_header(record_header_t* header, int keyframe_interval)
+{
+    memset(header, 0, sizeof(record_header_t));
+    header->magic = RECORD_MAGIC;
+    header->version = RECORD_VERSION;
+    header->map_max_x = MAP_MAX_X;
+    header->map_max_y = MAP_MAX_Y;
+    header->n_teams = N_TEAMS;
+    header->n_spaceships = N_SPACESHIPS;
+    header->keyframe_interval = keyframe_interval;
+}
+
+static status write_frame(recorder_t* rec,
+                          int type,
+                          int turn,
+                          uint64_t hash,
+                          size_t len)
+{
+    unsigned char head[1 + 2 * FRAME_MAX_VARINT];
+    size_t n = 0;
+
+    head[n++] = type;
+    n += frame_put_varint(head + n, turn);
+    n += frame_put_varint(head + n, len);
+    if (fwrite(head, 1, n, rec->data) != n ||
+        fwrite(&hash, sizeof(hash), 1, rec->data) != 1 ||
+        fwrite(frame_buffer, 1, len, rec->data) != len) {
+        return ERROR;
+    }
+
+    return OK;
+}
+
+static status read_frame(replay_t* rep, map_t* map)
+{
+    int type;
+    unsigned int turn, len;
+
+    type = fgetc(rep->data);
+    if (type == EOF || !read_varint(rep->data, &turn) ||
+        !read_varint(rep->data, &len) || len > FRAME_MAX_SIZE) {
+        return ERROR;
+    }
+    // A delta only makes sense on top of the previous turn
+    if (type == FRAME_DELTA && (int)turn != rep->turn + 1) {
+        return ERROR;
+    }
+    if (fread(&rep->hash, sizeof(rep->hash), 1, rep->data) != 1 ||
+        fread(frame_buffer, 1, len, rep->data) != len ||
+        !frame_apply(map, type, frame_buffer, len)) {
+        return ERROR;
+    }
+    rep->turn = turn;
+    if (map->hash != rep->hash && rep->diverged < 0) {
+        rep->diverged = turn;
+    }
+
+    return OK;
+}
+
+static int read_varint(FILE* f, unsigned int* value)
+{
+    int c, n;
+
+    *value = 0;
+    for (n = 0; n < FRAME_MAX_VARINT; n++) {
+        c = fgetc(f);
+        if (c == EOF) {
+            return 0;
+        }
+        *value |= (unsigned int)(c & 0x7f) << (7 * n);
+        if (!(c & 0x80)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
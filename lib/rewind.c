@@ -0,0 +1,150 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "rewind.h"
+
+#define REWIND_RETRIES 4
+
+static void drop_oldest(rewind_t* rewind);
+static size_t page_len(int page);
+
+void rewind_init(rewind_t* rewind)
+{
+    int i;
+
+    memset(rewind, 0, offsetof(rewind_t, pool));
+    rewind->head = REWIND_SLOTS - 1;
+    for (i = 0; i < REWIND_SLOTS; i++) {
+        rewind->slots[i].turn = -1;
+    }
+    for (i = 0; i < REWIND_POOL_PAGES; i++) {
+        rewind->free_pages[i] = i;
+    }
+    rewind->n_free = REWIND_POOL_PAGES;
+}
+
+void rewind_push(rewind_t* rewind, map_t* map)
+{
+    int i, page, prev;
+    rewind_slot_t* slot = NULL;
+    rewind_slot_t* last = &rewind->slots[rewind->head];
+    unsigned char* src;
+
+    while (rewind->count == REWIND_SLOTS ||
+           (rewind->count > 0 && rewind->n_free < (int)REWIND_MAP_PAGES)) {
+        drop_oldest(rewind);
+    }
+
+    slot = &rewind->slots[(rewind->head + 1) % REWIND_SLOTS];
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    // Dirty pages are found comparing with the previous snapshot, so no page
+    // protection or shadow copy is needed
+    for (i = 0; i < (int)REWIND_MAP_PAGES; i++) {
+        src = (unsigned char*)map + (size_t)i * REWIND_PAGE_SIZE;
+        prev = rewind->count ? last->pages[i] : -1;
+        if (prev >= 0 && memcmp(rewind->pool[prev], src, page_len(i)) == 0) {
+            rewind->refcount[prev]++;
+            slot->pages[i] = prev;
+            rewind->pages_shared++;
+            continue;
+        }
+        page = rewind->free_pages[--rewind->n_free];
+        memcpy(rewind->pool[page], src, page_len(i));
+        rewind->refcount[page] = 1;
+        slot->pages[i] = page;
+        rewind->pages_copied++;
+    }
+    slot->turn = map->turn;
+
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(
+      &rewind->head, (rewind->head + 1) % REWIND_SLOTS, __ATOMIC_RELEASE);
+    __atomic_store_n(&rewind->count, rewind->count + 1, __ATOMIC_RELEASE);
+}
+
+bool rewind_read(rewind_t* rewind, int turn, map_t* map)
+{
+    int i, k, n, head, try;
+    unsigned int seq;
+    rewind_slot_t* slot = NULL;
+
+    for (try = 0; try < REWIND_RETRIES; try++) {
+        head = __atomic_load_n(&rewind->head, __ATOMIC_ACQUIRE);
+        n = __atomic_load_n(&rewind->count, __ATOMIC_ACQUIRE);
+        for (k = 0; k < n; k++) {
+            slot = &rewind->slots[(head - k + REWIND_SLOTS) % REWIND_SLOTS];
+            if (__atomic_load_n(&slot->turn, __ATOMIC_RELAXED) == turn) {
+                break;
+            }
+        }
+        if (k == n) {
+            return false;
+        }
+
+        // A page is only reused after every slot using it is dropped, which
+        // changes the seq of the slot being read
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+        for (i = 0; i < (int)REWIND_MAP_PAGES; i++) {
+            memcpy((unsigned char*)map + (size_t)i * REWIND_PAGE_SIZE,
+                   rewind->pool[slot->pages[i] % REWIND_POOL_PAGES],
+                   page_len(i));
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq &&
+            slot->turn == turn) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool rewind_range(rewind_t* rewind, int* oldest, int* newest)
+{
+    int head = __atomic_load_n(&rewind->head, __ATOMIC_ACQUIRE);
+    int n = __atomic_load_n(&rewind->count, __ATOMIC_ACQUIRE);
+
+    if (n == 0) {
+        return false;
+    }
+    *newest = rewind->slots[head].turn;
+    *oldest = rewind->slots[(head - n + 1 + REWIND_SLOTS) % REWIND_SLOTS].turn;
+
+    return *oldest >= 0 && *newest >= 0;
+}
+
+static void drop_oldest(rewind_t* rewind)
+{
+    int i, page;
+    rewind_slot_t* slot =
+      &rewind->slots[(rewind->head - rewind->count + 1 + REWIND_SLOTS) %
+                     REWIND_SLOTS];
+
+    // Readers must not find it before its pages go back to the pool
+    __atomic_store_n(&rewind->count, rewind->count - 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (i = 0; i < (int)REWIND_MAP_PAGES; i++) {
+        page = slot->pages[i];
+        if (--rewind->refcount[page] == 0) {
+            rewind->free_pages[rewind->n_free++] = page;
+        }
+    }
+    slot->turn = -1;
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* The last page of the map is not full. */
+static size_t page_len(int page)
+{
+    size_t offset = (size_t)page * REWIND_PAGE_SIZE;
+
+    return (sizeof(map_t) - offset < REWIND_PAGE_SIZE)
+             ? sizeof(map_t) - offset
+             : REWIND_PAGE_SIZE;
+}
@@ -0,0 +1,208 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "scenario.h"
+
+extern char team_symbols[N_TEAMS];
+
+static const char* formation_names[N_FORMATIONS] = {
+    "random", "line", "column", "block", "wedge"
+};
+
+static status parse_line(scenario_t* scenario, char* line);
+static void add_asteroids(scenario_t* scenario,
+                          int posy,
+                          int posx,
+                          int rows,
+                          int columns);
+
+status scenario_load(scenario_t* scenario, const char* path)
+{
+    int fd, i, n_line, n_free;
+    struct stat st;
+    char* data;
+    char* end;
+    char* p;
+    char* eol;
+    char line[SCENARIO_MAX_LINE];
+    size_t len;
+
+    memset(scenario, 0, sizeof(scenario_t));
+    scenario->height = MAP_MAX_Y;
+    scenario->width = MAP_MAX_X;
+    for (i = 0; i < N_TEAMS; i++) {
+        scenario->formation[i] = FORMATION_RANDOM;
+        scenario->posy[i] = -1;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror("[SCENARIO] Error opening the scenario...\n");
+        return ERROR;
+    }
+    if (fstat(fd, &st) == -1) {
+        perror("[SCENARIO] Error opening the scenario...\n");
+        close(fd);
+        return ERROR;
+    }
+    // An empty file is a valid scenario, and mmap does not take size 0
+    data = NULL;
+    if (st.st_size > 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror("[SCENARIO] Error mapping the scenario...\n");
+            close(fd);
+            return ERROR;
+        }
+    }
+    close(fd);
+
+    // The file is not NUL terminated, each line is copied before parsing
+    end = data + st.st_size;
+    for (p = data, n_line = 1; p < end; p = eol + 1, n_line++) {
+        eol = memchr(p, '\n', end - p);
+        if (!eol) {
+            eol = end;
+        }
+        len = eol - p;
+        if (len >= SCENARIO_MAX_LINE) {
+            fprintf(stderr, "[SCENARIO] Line %d too long...\n", n_line);
+            break;
+        }
+        memcpy(line, p, len);
+        line[len] = '\0';
+        if (!parse_line(scenario, line)) {
+            fprintf(stderr, "[SCENARIO] Invalid line %d: %s\n", n_line, line);
+            break;
+        }
+    }
+    if (data) {
+        munmap(data, st.st_size);
+    }
+    if (p < end) {
+        return ERROR;
+    }
+
+    // The squares out of the playable area are asteroids too
+    add_asteroids(scenario,
+                  0,
+                  scenario->width,
+                  MAP_MAX_Y,
+                  MAP_MAX_X - scenario->width);
+    add_asteroids(scenario,
+                  scenario->height,
+                  0,
+                  MAP_MAX_Y - scenario->height,
+                  MAP_MAX_X);
+    n_free = MAP_MAX_Y * MAP_MAX_X;
+    for (i = 0; i < MAP_VISIBLE_WORDS; i++) {
+        n_free -= __builtin_popcountll(scenario->asteroids[i]);
+    }
+    if (n_free < N_TEAMS * N_SPACESHIPS) {
+        fprintf(stderr,
+                "[SCENARIO] Only %d free squares for %d spaceships...\n",
+                n_free,
+                N_TEAMS * N_SPACESHIPS);
+        return ERROR;
+    }
+
+    return OK;
+}
+
+const char* scenario_formation_name(formation_t formation)
+{
+    return formation_names[formation];
+}
+
+/* Returns ERROR if the line is malformed. Blank lines and comments are
+ * valid. */
+static status parse_line(scenario_t* scenario, char* line)
+{
+    char keyword[16], symbol, formation[16];
+    int n, a, b, c, d;
+    int i;
+    char* comment;
+
+    comment = strchr(line, '#');
+    if (comment) {
+        *comment = '\0';
+    }
+    n = sscanf(line, "%15s", keyword);
+    if (n <= 0) {
+        return OK;
+    }
+
+    if (strcmp(keyword, "size") == 0) {
+        if (sscanf(line, "%*s %d %d", &a, &b) != 2 || a <= 0 ||
+            a > MAP_MAX_Y || b <= 0 || b > MAP_MAX_X) {
+            return ERROR;
+        }
+        scenario->height = a;
+        scenario->width = b;
+        return OK;
+    }
+
+    if (strcmp(keyword, "asteroid") == 0) {
+        n = sscanf(line, "%*s %d %d %d %d", &a, &b, &c, &d);
+        if (n == 2) {
+            c = d = 1;
+        } else if (n != 4) {
+            return ERROR;
+        }
+        if (a < 0 || b < 0 || c <= 0 || d <= 0 || a + c > MAP_MAX_Y ||
+            b + d > MAP_MAX_X) {
+            return ERROR;
+        }
+        add_asteroids(scenario, a, b, c, d);
+        return OK;
+    }
+
+    if (strcmp(keyword, "team") == 0) {
+        n = sscanf(line, "%*s %c %15s %d %d", &symbol, formation, &a, &b);
+        if (n < 2) {
+            return ERROR;
+        }
+        for (i = 0; i < N_TEAMS && team_symbols[i] != symbol; i++) {
+        }
+        if (i == N_TEAMS) {
+            return ERROR;
+        }
+        for (c = 0; c < N_FORMATIONS; c++) {
+            if (strcmp(formation, formation_names[c]) == 0) {
+                break;
+            }
+        }
+        // Every formation but random needs its anchor
+        if (c == N_FORMATIONS ||
+            (c != FORMATION_RANDOM &&
+             (n != 4 || a < 0 || a >= MAP_MAX_Y || b < 0 || b >= MAP_MAX_X))) {
+            return ERROR;
+        }
+        scenario->formation[i] = c;
+        scenario->posy[i] = (c != FORMATION_RANDOM) ? a : -1;
+        scenario->posx[i] = (c != FORMATION_RANDOM) ? b : -1;
+        return OK;
+    }
+
+    return ERROR;
+}
+
+static void add_asteroids(scenario_t* scenario,
+                          int posy,
+                          int posx,
+                          int rows,
+                          int columns)
+{
+    int i, j, bit;
+
+    for (i = posy; i < posy + rows; i++) {
+        for (j = posx; j < posx + columns; j++) {
+            bit = i * MAP_MAX_X + j;
+            scenario->asteroids[bit / 64] |= 1ULL << (bit % 64);
+        }
+    }
+}
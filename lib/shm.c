@@ -0,0 +1,294 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shm.h"
+
+#define SHM_NODES_ONLINE "/sys/devices/system/node/online"
+#define SHM_MAX_NODES 64
+#define SHM_MPOL_INTERLEAVE 3 // MPOL_INTERLEAVE of <numaif.h>
+
+static void huge_path(char* path, size_t len, const char* name);
+static int interleave(void* addr, size_t size);
+static void prefault(shm_region_t* region);
+static void begin_setup(struct rusage* usage, struct timespec* start);
+static void end_setup(shm_region_t* region,
+                      struct rusage* usage,
+                      struct timespec* start);
+
+status shm_region_create(shm_region_t* region,
+                         const char* name,
+                         size_t size,
+                         int flags)
+{
+    char path[PATH_MAX];
+    struct rusage usage;
+    struct timespec start;
+    int mmap_flags = MAP_SHARED;
+
+    memset(region, 0, sizeof(shm_region_t));
+    region->fd = -1;
+    region->addr = MAP_FAILED;
+    begin_setup(&usage, &start);
+
+    // Huge pages come from hugetlbfs because other processes must be able to
+    // open the region by name, which a memfd does not allow
+    if (flags & SHM_HUGE) {
+        huge_path(path, sizeof(path), name);
+        region->fd = open(path, O_CREAT | O_EXCL | O_RDWR, S_IWUSR | S_IRUSR);
+        if (region->fd != -1) {
+            region->size = (size + SHM_HUGE_PAGE_SIZE - 1) &
+                           ~((size_t)SHM_HUGE_PAGE_SIZE - 1);
+            if (ftruncate(region->fd, region->size) == 0) {
+                region->addr = mmap(NULL,
+                                    region->size,
+                                    PROT_READ | PROT_WRITE,
+                                    mmap_flags,
+                                    region->fd,
+                                    0);
+            }
+            if (region->addr == MAP_FAILED) {
+                // Usually no huge pages are reserved
+                close(region->fd);
+                unlink(path);
+                region->fd = -1;
+            } else {
+                region->backend = SHM_BACKEND_HUGETLBFS;
+            }
+        }
+    }
+
+    if (region->addr == MAP_FAILED) {
+        region->backend = SHM_BACKEND_POSIX;
+        region->size = size;
+        region->fd =
+          shm_open(name, O_CREAT | O_EXCL | O_RDWR, S_IWUSR | S_IRUSR);
+        if (region->fd == -1) {
+            return ERROR;
+        }
+        if (ftruncate(region->fd, size) == -1) {
+            return ERROR;
+        }
+        region->addr = mmap(
+          NULL, size, PROT_READ | PROT_WRITE, mmap_flags, region->fd, 0);
+        if (region->addr == MAP_FAILED) {
+            return ERROR;
+        }
+#ifdef MADV_HUGEPAGE
+        // Transparent huge pages for tmpfs, if the kernel allows them
+        if (flags & SHM_HUGE) {
+            madvise(region->addr, size, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+    // The policy must be set before the pages are faulted in
+    if (flags & SHM_INTERLEAVE) {
+        region->numa_nodes = interleave(region->addr, region->size);
+    }
+    if (flags & SHM_PREFAULT) {
+        prefault(region);
+    }
+    end_setup(region, &usage, &start);
+
+    return OK;
+}
+
+status shm_region_attach(shm_region_t* region,
+                         const char* name,
+                         size_t size,
+                         int prot,
+                         int flags)
+{
+    char path[PATH_MAX];
+    struct rusage usage;
+    struct timespec start;
+    struct stat st;
+    int mode = (prot & PROT_WRITE) ? O_RDWR : O_RDONLY;
+    int mmap_flags = MAP_SHARED;
+
+    memset(region, 0, sizeof(shm_region_t));
+    region->addr = MAP_FAILED;
+    begin_setup(&usage, &start);
+
+    huge_path(path, sizeof(path), name);
+    region->fd = open(path, mode);
+    if (region->fd != -1) {
+        region->backend = SHM_BACKEND_HUGETLBFS;
+    } else {
+        region->backend = SHM_BACKEND_POSIX;
+        region->fd = shm_open(name, mode, 0);
+        if (region->fd == -1) {
+            return ERROR;
+        }
+    }
+
+    // The creator may have rounded the size up to its page size
+    region->size = size;
+    if (fstat(region->fd, &st) == 0 && st.st_size > (off_t)size) {
+        region->size = st.st_size;
+    }
+
+    if (flags & SHM_PREFAULT) {
+        mmap_flags |= MAP_POPULATE;
+    }
+    region->addr =
+      mmap(NULL, region->size, prot, mmap_flags, region->fd, 0);
+    if (region->addr == MAP_FAILED) {
+        return ERROR;
+    }
+    end_setup(region, &usage, &start);
+
+    return OK;
+}
+
+void shm_region_detach(shm_region_t* region)
+{
+    // Never created nor attached
+    if (region->addr == NULL) {
+        return;
+    }
+    if (region->addr != MAP_FAILED) {
+        munmap(region->addr, region->size);
+        region->addr = MAP_FAILED;
+    }
+    if (region->fd >= 0) {
+        close(region->fd);
+        region->fd = -1;
+    }
+}
+
+void shm_region_destroy(shm_region_t* region, const char* name)
+{
+    char path[PATH_MAX];
+
+    shm_region_detach(region);
+    if (region->backend == SHM_BACKEND_HUGETLBFS) {
+        huge_path(path, sizeof(path), name);
+        unlink(path);
+    } else {
+        shm_unlink(name);
+    }
+}
+
+void shm_region_report(shm_region_t* region, const char* who)
+{
+    fprintf(stdout,
+            "[%s] Shared memory: %zu KB on %s, %d NUMA nodes, %ld minor and "
+            "%ld major page faults, %.3f ms of setup...\n",
+            who,
+            region->size / 1024,
+            (region->backend == SHM_BACKEND_HUGETLBFS) ? "huge pages"
+                                                       : "/dev/shm",
+            region->numa_nodes,
+            region->minflt,
+            region->majflt,
+            region->setup_usec / 1000.0);
+}
+
+static void huge_path(char* path, size_t len, const char* name)
+{
+    while (*name == '/') {
+        name++;
+    }
+    snprintf(path, len, "%s/%s", SHM_HUGE_PATH, name);
+}
+
+/* Sets an interleave policy over the online nodes with the raw syscall, so
+ * libnuma is not needed. Returns the number of nodes used. */
+static int interleave(void* addr, size_t size)
+{
+    FILE* f;
+    unsigned long mask = 0;
+    int first, last, n_nodes = 0;
+    char sep;
+
+    f = fopen(SHM_NODES_ONLINE, "r");
+    if (!f) {
+        return 0;
+    }
+    // The file is a list of ranges such as "0-1,3"
+    while (fscanf(f, "%d", &first) == 1) {
+        last = first;
+        sep = fgetc(f);
+        if (sep == '-') {
+            if (fscanf(f, "%d", &last) != 1) {
+                break;
+            }
+            sep = fgetc(f);
+        }
+        for (; first <= last && first < SHM_MAX_NODES; first++) {
+            mask |= 1UL << first;
+            n_nodes++;
+        }
+        if (sep != ',') {
+            break;
+        }
+    }
+    fclose(f);
+
+    if (n_nodes < 2) {
+        return 0;
+    }
+    if (syscall(SYS_mbind,
+                addr,
+                size,
+                SHM_MPOL_INTERLEAVE,
+                &mask,
+                SHM_MAX_NODES + 1,
+                0) == -1) {
+        return 0;
+    }
+
+    return n_nodes;
+}
+
+static void prefault(shm_region_t* region)
+{
+    size_t i;
+    long page = sysconf(_SC_PAGESIZE);
+    volatile char* p = region->addr;
+
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(region->addr, region->size, MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
+#endif
+    // Older kernels: touch every page. The region is still zero filled.
+    if (region->backend == SHM_BACKEND_HUGETLBFS) {
+        page = SHM_HUGE_PAGE_SIZE;
+    }
+    for (i = 0; i < region->size; i += page) {
+        p[i] = 0;
+    }
+}
+
+static void begin_setup(struct rusage* usage, struct timespec* start)
+{
+    getrusage(RUSAGE_SELF, usage);
+    clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+static void end_setup(shm_region_t* region,
+                      struct rusage* usage,
+                      struct timespec* start)
+{
+    struct rusage now;
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_SELF, &now);
+    region->minflt = now.ru_minflt - usage->ru_minflt;
+    region->majflt = now.ru_majflt - usage->ru_majflt;
+    region->setup_usec = (end.tv_sec - start->tv_sec) * 1000000L +
+                         (end.tv_nsec - start->tv_nsec) / 1000;
+}
@@ -0,0 +1,47 @@
+#include <string.h>
+
+#include "snapshot.h"
+
+#define SNAPSHOT_RETRIES 4
+
+void snapshot_init(snapshot_t* snapshot)
+{
+    snapshot->latest = -1;
+    snapshot->seq[0] = snapshot->seq[1] = 0;
+}
+
+void snapshot_publish(snapshot_t* snapshot, map_t* map)
+{
+    int next = (snapshot->latest == 0) ? 1 : 0;
+    unsigned int* seq = &snapshot->seq[next];
+
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&snapshot->maps[next], map, sizeof(map_t));
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&snapshot->latest, next, __ATOMIC_RELEASE);
+}
+
+bool snapshot_read(snapshot_t* snapshot, map_t* map)
+{
+    int try, buffer;
+    unsigned int seq;
+
+    for (try = 0; try < SNAPSHOT_RETRIES; try++) {
+        buffer = __atomic_load_n(&snapshot->latest, __ATOMIC_ACQUIRE);
+        if (buffer < 0) {
+            return false;
+        }
+        seq = __atomic_load_n(&snapshot->seq[buffer], __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+        memcpy(map, &snapshot->maps[buffer], sizeof(map_t));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&snapshot->seq[buffer], __ATOMIC_RELAXED) == seq) {
+            return true;
+        }
+    }
+
+    return false;
+}
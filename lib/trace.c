@@ -0,0 +1,230 @@
+#include <dirent.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define TRACE_SUFFIX ".trace" // Files of each process
+#define TRACE_MAX_LINE 256
+
+typedef struct {
+    const char* name;
+    char phase; // 'X' span, 's' flow start, 'f' flow end
+    uint64_t ts;
+    uint64_t dur;
+    uint64_t id; // Of a flow
+    int arg;
+} trace_event_t;
+
+static const char* dir = NULL;
+static char process_name[64];
+static trace_event_t events[TRACE_MAX_EVENTS];
+static int n_events = 0;
+static long lost = 0; // Events that did not fit
+static unsigned int n_flows = 0;
+
+static uint64_t now_nsec();
+static trace_event_t* add_event(const char* name, char phase, uint64_t ts);
+
+void trace_init(const char* name)
+{
+    dir = getenv(TRACE_DIR_ENV);
+    if (dir && !*dir) {
+        dir = NULL;
+    }
+    snprintf(process_name, sizeof(process_name), "%s", name);
+    n_events = 0;
+    lost = 0;
+}
+
+uint64_t trace_begin()
+{
+    return dir ? now_nsec() : 0;
+}
+
+void trace_end(const char* name, uint64_t start, int arg)
+{
+    trace_event_t* event;
+
+    if (!dir) {
+        return;
+    }
+    event = add_event(name, 'X', start);
+    if (event) {
+        event->dur = now_nsec() - start;
+        event->arg = arg;
+    }
+}
+
+uint64_t trace_flow_start()
+{
+    uint64_t id;
+    trace_event_t* event;
+
+    if (!dir) {
+        return 0;
+    }
+    // Unique across the processes of the match
+    id = (uint64_t)getpid() << 32 | ++n_flows;
+    event = add_event("message", 's', now_nsec());
+    if (event) {
+        event->id = id;
+    }
+
+    return id;
+}
+
+void trace_flow_end(uint64_t id)
+{
+    trace_event_t* event;
+
+    if (!dir || !id) {
+        return;
+    }
+    event = add_event("message", 'f', now_nsec());
+    if (event) {
+        event->id = id;
+    }
+}
+
+void trace_flush()
+{
+    int i;
+    char path[PATH_MAX];
+    FILE* f;
+    trace_event_t* event;
+    int pid = getpid();
+
+    if (!dir) {
+        return;
+    }
+    snprintf(path, sizeof(path), "%s/%d%s", dir, pid, TRACE_SUFFIX);
+    f = fopen(path, "w");
+    if (!f) {
+        perror("[TRACE] Error writing the trace of the process...\n");
+        return;
+    }
+
+    // One event per line, so merging is concatenating lines
+    fprintf(f,
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"args\":{\"name\":\"%s\"}}\n",
+            pid,
+            process_name);
+    for (i = 0; i < n_events; i++) {
+        event = &events[i];
+        fprintf(f,
+                "{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,"
+                "\"ts\":%.3f",
+                event->name,
+                event->phase,
+                pid,
+                pid,
+                event->ts / 1000.0);
+        if (event->phase == 'X') {
+            fprintf(f,
+                    ",\"dur\":%.3f,\"args\":{\"arg\":%d}}\n",
+                    event->dur / 1000.0,
+                    event->arg);
+        } else {
+            // The end of a flow binds to the span around it
+            fprintf(f,
+                    ",\"id\":\"%llx\",\"cat\":\"message\"%s}\n",
+                    (unsigned long long)event->id,
+                    (event->phase == 'f') ? ",\"bp\":\"e\"" : "");
+        }
+    }
+    fclose(f);
+    if (lost) {
+        fprintf(stderr, "[TRACE] %s lost %ld events...\n", process_name, lost);
+    }
+    n_events = 0;
+}
+
+status trace_merge()
+{
+    DIR* d;
+    struct dirent* entry;
+    FILE *out, *in;
+    char path[PATH_MAX];
+    char line[TRACE_MAX_LINE];
+    size_t len;
+    bool first = true;
+
+    if (!dir) {
+        return OK;
+    }
+    snprintf(path, sizeof(path), "%s/%s", dir, TRACE_FILE);
+    out = fopen(path, "w");
+    d = opendir(dir);
+    if (!out || !d) {
+        perror("[TRACE] Error merging the traces...\n");
+        if (out) {
+            fclose(out);
+        }
+        if (d) {
+            closedir(d);
+        }
+        return ERROR;
+    }
+
+    fprintf(out, "{\"traceEvents\":[\n");
+    while ((entry = readdir(d)) != NULL) {
+        len = strlen(entry->d_name);
+        if (len <= strlen(TRACE_SUFFIX) ||
+            strcmp(entry->d_name + len - strlen(TRACE_SUFFIX),
+                   TRACE_SUFFIX) != 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        in = fopen(path, "r");
+        if (!in) {
+            continue;
+        }
+        while (fgets(line, sizeof(line), in)) {
+            line[strcspn(line, "\n")] = '\0';
+            fprintf(out, "%s%s", first ? "" : ",\n", line);
+            first = false;
+        }
+        fclose(in);
+        unlink(path);
+    }
+    fprintf(out, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    closedir(d);
+    fclose(out);
+
+    return OK;
+}
+
+static uint64_t now_nsec()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static trace_event_t* add_event(const char* name, char phase, uint64_t ts)
+{
+    trace_event_t* event;
+
+    if (n_events == TRACE_MAX_EVENTS) {
+        lost++;
+        return NULL;
+    }
+    event = &events[n_events++];
+    event->name = name;
+    event->phase = phase;
+    event->ts = ts;
+    event->dur = 0;
+    event->id = 0;
+    event->arg = 0;
+
+    return event;
+}
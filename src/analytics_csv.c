@@ -0,0 +1,62 @@
+#include <stdio.h>  // fprintf, printf
+#include <stdlib.h> // exit
+#include <string.h> // strcmp
+
+#include "analytics.h"
+
+static void print_table(analytics_table_t* table);
+
+int main(int argc, char* argv[])
+{
+    analytics_t analytics;
+    int i;
+
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "Usage: %s <analytics> [table]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!analytics_load(&analytics, argv[1])) {
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < ANALYTICS_N_TABLES; i++) {
+        if (argc == 2) {
+            // Without a table, list them
+            fprintf(stdout,
+                    "%s: %u rows, %u columns\n",
+                    analytics.tables[i].name,
+                    analytics.tables[i].n_rows,
+                    analytics.tables[i].n_columns);
+        } else if (strcmp(analytics.tables[i].name, argv[2]) == 0) {
+            print_table(&analytics.tables[i]);
+            break;
+        }
+    }
+    analytics_free(&analytics);
+
+    if (argc == 3 && i == ANALYTICS_N_TABLES) {
+        fprintf(stderr, "[ANALYTICS] There is no table %s...\n", argv[2]);
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+static void print_table(analytics_table_t* table)
+{
+    uint32_t i, j;
+
+    for (j = 0; j < table->n_columns; j++) {
+        printf("%s%c",
+               table->columns[j],
+               (j + 1 < table->n_columns) ? ',' : '\n');
+    }
+    for (i = 0; i < table->n_rows; i++) {
+        for (j = 0; j < table->n_columns; j++) {
+            printf("%d%c",
+                   table->data[j][i],
+                   (j + 1 < table->n_columns) ? ',' : '\n');
+        }
+    }
+}
@@ -1,19 +1,43 @@
-#include <signal.h> // sigaction
-#include <stdio.h>  // fprintf
-#include <stdlib.h> // exit
-#include <time.h>   // time
-#include <unistd.h> // pipes
-#include <wait.h>   // wait
+#include <fcntl.h>     // O_* constants
+#include <semaphore.h> // sem_open
+#include <signal.h>    // sigaction
+#include <stdint.h>    // uint64_t
+#include <stdio.h>     // fprintf
+#include <stdlib.h>    // exit
+#include <sys/mman.h>  // PROT_READ
+#include <time.h>      // time
+#include <unistd.h>    // pipes
+#include <wait.h>      // wait
 
+#include "ai.h"
+#include "ipc.h"
+#include "map.h"
+#include "shm.h"
 #include "simulator.h"
+#include "snapshot.h"
+#include "trace.h"
 
 int fd_pipe_spaceships[N_SPACESHIPS][2]; // Communicate with spaceships
                                          // processes
+ipc_names_t ipc_names;     // Names of the resources of the instance
+shm_region_t shm_map;      // Shared memory with the map
+map_t* pmap = NULL;        // pointer to the map
+shm_region_t shm_snapshot; // Shared memory with the last turn, if pipelined
+snapshot_t* psnapshot = NULL;
+sem_t* sem_w = NULL;       // semaphore for writers
+sem_t* sem_r = NULL;       // semaphore for readers
+sem_t* sem_mutex = NULL;   // semaphore for mutex sem_r
+sem_t* sem_count_r = NULL; // semaphore for counting readers
+
+static map_t committed; // Copy of the last turn to decide on, if pipelined
+
+extern char team_symbols[N_TEAMS];
 
 static status init_shared_resources(int team);
 static void free_resources();
 static void handler_SIGTERM(int signal);
-static unsigned int rand_interval(unsigned int min, unsigned int max);
+static void begin_read();
+static void end_read();
 
 int main(int argc, char* argv[])
 {
@@ -21,15 +45,26 @@ int main(int argc, char* argv[])
     int team; // Team of this leader
     pid_t pid;
     char id_spaceship[MAX_CHAR_ID];
+    char name[MAX_CHAR_ID + 8];
     command_t cmd;
-    unsigned int r; // Rand number to choose between attack and move
+    uint64_t span, targets_span;
+    const char* span_name;
+    unsigned int seed; // Seed of the random actions
+    spaceship_t targets[N_SPACESHIPS];
 
-    if (argc != 2) {
+    // The instance id is optional, so leaders can still be run by hand
+    if (argc != 2 && argc != 3) {
         fprintf(stderr, "[LEADER] Wrong number of arguments...\n");
         exit(EXIT_FAILURE);
     }
 
     team = atoi(argv[1]); // identifier of the leader team
+    if (!ipc_names_init(&ipc_names, (argc == 3) ? argv[2] : NULL)) {
+        fprintf(stderr, "[LEADER] Invalid instance id...\n");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(name, sizeof(name), "leader %c", team_symbols[team % N_TEAMS]);
+    trace_init(name);
 
     // Init resources
     if (!init_shared_resources(team)) {
@@ -51,33 +86,61 @@ int main(int argc, char* argv[])
             dup2(fd_pipe_spaceships[i][READ], STDIN_FILENO);
             close(fd_pipe_spaceships[i][READ]);
             sprintf(id_spaceship, "%d", i);
-            execl("./spaceship", "spaceship", argv[1], id_spaceship, NULL);
+            execl("./spaceship",
+                  "spaceship",
+                  argv[1],
+                  id_spaceship,
+                  (argc == 3) ? argv[2] : "",
+                  NULL);
             perror("[LEADER]: execl");
             exit(EXIT_FAILURE);
         }
     }
 
     // Main loop
-    srandom(time(NULL));
+    seed = time(NULL) ^ getpid();
     while (1) {
         fprintf(stdout,
                 "[LEADER %d] Reading the next command from the simulator...\n",
                 team);
         read(STDIN_FILENO, &cmd, sizeof(command_t));
+        span = trace_begin();
+        span_name = (cmd.type == DESTROY) ? "DESTROY" : "TURN";
+        trace_flow_end(cmd.flow);
         switch (cmd.type) {
             case TURN:
                 for (i = 0; i < N_ACTIONS_LEADER; i++) {
                     // Calculate a random action
-                    r = rand_interval(0, 1);
-                    switch (r) {
+                    switch (ai_leader_action(&seed)) {
                         case ATTACK:
+                            // Targets are chosen once for the whole fleet
                             cmd.type = ATTACK;
+                            targets_span = trace_begin();
+                            if (!pmap->pipelined) {
+                                begin_read();
+                                ai_assign_targets(pmap, team, targets);
+                                end_read();
+                            } else if (snapshot_read(psnapshot, &committed)) {
+                                ai_assign_targets(&committed, team, targets);
+                            } else {
+                                // The spaceships choose on their own
+                                for (j = 0; j < N_SPACESHIPS; j++) {
+                                    targets[j].team = targets[j].id = -1;
+                                }
+                            }
+                            trace_end("assign targets", targets_span, i);
                             for (j = 0; j < N_SPACESHIPS; j++) {
+                                cmd.target_team = targets[j].team;
+                                cmd.target_id = targets[j].id;
                                 fprintf(stdout,
                                         "[LEADER %d] Sending ATTACK command to "
-                                        "spaceship with id %d...\n",
+                                        "spaceship with id %d, target %d/%d"
+                                        "...\n",
                                         team,
-                                        j);
+                                        j,
+                                        cmd.target_team,
+                                        cmd.target_id);
+                                cmd.flow = trace_flow_start();
                                 write(fd_pipe_spaceships[j][WRITE],
                                       &cmd,
                                       sizeof(command_t));
@@ -85,12 +148,14 @@ int main(int argc, char* argv[])
                             break;
                         case MOVE:
                             cmd.type = MOVE;
+                            cmd.target_team = cmd.target_id = -1;
                             for (j = 0; j < N_SPACESHIPS; j++) {
                                 fprintf(stdout,
                                         "[LEADER %d] Sending MOVE command to "
                                         "spaceship with id %d...\n",
                                         team,
                                         j);
+                                cmd.flow = trace_flow_start();
                                 write(fd_pipe_spaceships[j][WRITE],
                                       &cmd,
                                       sizeof(command_t));
@@ -105,11 +170,13 @@ int main(int argc, char* argv[])
                         "id %d...\n",
                         team,
                         cmd.id_spaceship);
+                cmd.flow = trace_flow_start();
                 write(fd_pipe_spaceships[cmd.id_spaceship][WRITE],
                       &cmd,
                       sizeof(command_t));
                 break;
         }
+        trace_end(span_name, span, team);
         // Check if it is the end
         if (cmd.type == END) {
             break;
@@ -137,6 +204,55 @@ static status init_shared_resources(int team)
         }
     }
 
+    // Shared memory, to choose the targets
+    fprintf(stdout, "[LEADER %d] Managing shared memory...\n", team);
+    if (!shm_region_attach(&shm_map,
+                           ipc_names.shm_map,
+                           sizeof(map_t),
+                           PROT_READ,
+                           SHM_PREFAULT)) {
+        perror("[LEADER] Error opening the shared memory...\n");
+        return ERROR;
+    }
+    pmap = (map_t*)shm_map.addr;
+    if (pmap->pipelined) {
+        if (!shm_region_attach(&shm_snapshot,
+                               ipc_names.shm_snapshot,
+                               sizeof(snapshot_t),
+                               PROT_READ,
+                               0)) {
+            perror("[LEADER] Error opening the snapshot...\n");
+            return ERROR;
+        }
+        psnapshot = (snapshot_t*)shm_snapshot.addr;
+    }
+
+    // Semaphores
+    fprintf(stdout, "[LEADER %d] Managing semaphores...\n", team);
+    sem_w = sem_open(ipc_names.sem_w, O_RDWR);
+    if (sem_w == SEM_FAILED) {
+        perror("[LEADER] Error opening the semaphore sem_w..\n");
+        return ERROR;
+    }
+
+    sem_r = sem_open(ipc_names.sem_r, O_RDWR);
+    if (sem_r == SEM_FAILED) {
+        perror("[LEADER] Error opening the semaphore sem_r...\n");
+        return ERROR;
+    }
+
+    sem_mutex = sem_open(ipc_names.sem_mutex, O_RDWR);
+    if (sem_mutex == SEM_FAILED) {
+        perror("[LEADER] Error opening the semaphore sem_mutex...\n");
+        return ERROR;
+    }
+
+    sem_count_r = sem_open(ipc_names.sem_count_r, O_RDWR);
+    if (sem_count_r == SEM_FAILED) {
+        perror("[LEADER] Error opening the semaphore sem_count_r...\n");
+        return ERROR;
+    }
+
     // Signals
     fprintf(stdout, "[LEADER %d] Managing signals...\n", team);
     sigemptyset(&(act.sa_mask));
@@ -179,6 +295,22 @@ static void free_resources()
         close(fd_pipe_spaceships[i][WRITE]);
         close(fd_pipe_spaceships[i][READ]);
     }
+    trace_flush();
+    // Note: the simulator unlinks them
+    if (sem_w) {
+        sem_close(sem_w);
+    }
+    if (sem_r) {
+        sem_close(sem_r);
+    }
+    if (sem_mutex) {
+        sem_close(sem_mutex);
+    }
+    if (sem_count_r) {
+        sem_close(sem_count_r);
+    }
+    shm_region_detach(&shm_snapshot);
+    shm_region_detach(&shm_map);
 }
 
 static void handler_SIGTERM(int signal)
@@ -188,16 +320,29 @@ static void handler_SIGTERM(int signal)
     exit(EXIT_SUCCESS);
 }
 
-static unsigned int rand_interval(unsigned int min, unsigned int max)
+/* Same readers protocol as the spaceships. */
+static void begin_read()
 {
-    int r;
-    const unsigned int range = 1 + max - min;
-    const unsigned int buckets = RAND_MAX / range;
-    const unsigned int limit = buckets * range;
+    int sval;
+
+    sem_wait(sem_mutex);
+    sem_wait(sem_r);
+    sem_post(sem_count_r);
+    sem_getvalue(sem_count_r, &sval);
+    if (sval == 1) {
+        sem_wait(sem_w);
+    }
+    sem_post(sem_r);
+    sem_post(sem_mutex);
+}
 
-    do {
-        r = random();
-    } while (r >= limit);
+static void end_read()
+{
+    int sval;
 
-    return min + (r / buckets);
+    sem_wait(sem_count_r);
+    sem_getvalue(sem_count_r, &sval);
+    if (sval == 0) {
+        sem_post(sem_w);
+    }
 }
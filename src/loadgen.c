@@ -0,0 +1,365 @@
+#include <errno.h>    // errno
+#include <fcntl.h>    // O_* constants
+#include <mqueue.h>   // mq_open
+#include <stdio.h>    // fprintf, perror
+#include <stdlib.h>   // exit, atoi, qsort
+#include <string.h>   // memset
+#include <sys/mman.h> // PROT_READ
+#include <time.h>     // clock_gettime
+#include <unistd.h>   // getopt, usleep
+
+#include "ipc.h"
+#include "map.h"
+#include "shm.h"
+#include "simulator.h"
+
+#define LOADGEN_RATE 1000      // Moves per second
+#define LOADGEN_DURATION 10    // Seconds sending moves
+#define LOADGEN_ATTACKS 50     // Percentage of ATTACK moves
+#define LOADGEN_HOTSPOT_SIZE 2 // Squares around the center of the hotspot
+#define LOADGEN_MAX_WAIT 200   // Max microseconds between acknowledgements
+#define LOADGEN_PENDING 256    // More than a queue and its head can hold
+
+/* Moves sent to a team queue and not acknowledged yet, oldest first. */
+typedef struct {
+    unsigned int seq[LOADGEN_PENDING];
+    long sent_usec[LOADGEN_PENDING];
+    int first;
+    int count;
+    unsigned int next_seq;
+} pending_t;
+
+ipc_names_t ipc_names;  // Names of the resources of the instance
+shm_region_t shm_map;   // Shared memory with the map
+map_t* pmap = NULL;     // pointer to the map
+mqd_t queues[N_TEAMS];  // message queue of each team
+pending_t pending[N_TEAMS];
+long* latencies = NULL; // usec from the send to the acknowledgement
+long n_latencies = 0;
+long max_latencies = 0;
+
+static status init_shared_resources();
+static void free_resources();
+static void build_move(move_t* move,
+                       int ship,
+                       int attacks,
+                       int hotspot,
+                       int hotspoty,
+                       int hotspotx,
+                       unsigned int* seed);
+static void collect_acks(long now);
+static long now_usec();
+static long percentile(double p);
+static int compare_long(const void* a, const void* b);
+
+int main(int argc, char* argv[])
+{
+    int i, opt, team;
+    int n_ships = N_TEAMS * N_SPACESHIPS;
+    int rate = LOADGEN_RATE;
+    int duration = LOADGEN_DURATION;
+    int attacks = LOADGEN_ATTACKS;
+    int hotspot = 0;
+    int hotspoty, hotspotx;
+    char* instance = NULL;
+    unsigned int seed = time(NULL);
+    long start, end, due, now, sending_usec;
+    long sent = 0, full = 0, lost = 0;
+    int accepted = 0, dropped = 0;
+    move_t move;
+    pending_t* queue;
+
+    while ((opt = getopt(argc, argv, "i:n:r:d:a:H:s:")) != -1) {
+        switch (opt) {
+            case 'i':
+                instance = optarg;
+                break;
+            case 'n':
+                n_ships = atoi(optarg);
+                break;
+            case 'r':
+                rate = atoi(optarg);
+                break;
+            case 'd':
+                duration = atoi(optarg);
+                break;
+            case 'a':
+                attacks = atoi(optarg);
+                break;
+            case 'H':
+                hotspot = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr,
+                        "Usage: %s [-i instance] [-n ships] [-r rate] "
+                        "[-d duration] [-a attack_percent] "
+                        "[-H hotspot_percent] [-s seed]\n",
+                        argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (n_ships <= 0 || rate <= 0 || duration <= 0 || attacks < 0 ||
+        attacks > 100 || hotspot < 0 || hotspot > 100) {
+        fprintf(stderr, "[LOADGEN] Invalid arguments...\n");
+        exit(EXIT_FAILURE);
+    }
+    if (!ipc_names_init(&ipc_names, instance)) {
+        fprintf(stderr, "[LOADGEN] Invalid instance id...\n");
+        exit(EXIT_FAILURE);
+    }
+    if (!init_shared_resources()) {
+        free_resources();
+        exit(EXIT_FAILURE);
+    }
+
+    latencies = malloc((long)rate * duration * sizeof(long));
+    if (!latencies) {
+        perror("[LOADGEN] malloc");
+        free_resources();
+        exit(EXIT_FAILURE);
+    }
+    max_latencies = (long)rate * duration;
+
+    // Acknowledgements of earlier runs are not ours
+    for (i = 0; i < N_TEAMS; i++) {
+        pending[i].next_seq = pmap->acked[i] + 1 ? pmap->acked[i] + 1 : 1;
+        accepted -= pmap->admission[i].accepted;
+        dropped -= pmap->admission[i].dropped;
+    }
+    hotspoty = rand_r(&seed) % MAP_MAX_Y;
+    hotspotx = rand_r(&seed) % MAP_MAX_X;
+
+    fprintf(stdout,
+            "[LOADGEN] %d ships sending %d moves/s for %d s, %d%% attacks, "
+            "%d%% to the hotspot at %d %d...\n",
+            n_ships,
+            rate,
+            duration,
+            attacks,
+            hotspot,
+            hotspoty,
+            hotspotx);
+
+    // Moves are due at a fixed rate from the start, so a late send is
+    // followed by a burst instead of lowering the rate
+    start = now_usec();
+    end = start + duration * 1000000L;
+    for (i = 0; (now = now_usec()) < end; i++) {
+        due = start + (long)i * 1000000L / rate;
+        while (now < due) {
+            collect_acks(now);
+            usleep((due - now < LOADGEN_MAX_WAIT) ? due - now
+                                                  : LOADGEN_MAX_WAIT);
+            now = now_usec();
+        }
+
+        build_move(
+          &move, i % n_ships, attacks, hotspot, hotspoty, hotspotx, &seed);
+        team = move.team;
+        queue = &pending[team];
+        move.seq = queue->next_seq;
+        if (queue->count == LOADGEN_PENDING ||
+            mq_send(queues[team], (char*)&move, sizeof(move), 1) == -1) {
+            if (queue->count < LOADGEN_PENDING && errno != EAGAIN) {
+                perror("[LOADGEN] Error sending a move...\n");
+                break;
+            }
+            full++;
+            continue;
+        }
+        queue->seq[(queue->first + queue->count) % LOADGEN_PENDING] =
+          move.seq;
+        queue->sent_usec[(queue->first + queue->count) % LOADGEN_PENDING] =
+          now_usec();
+        queue->count++;
+        // 0 is the seq of the moves of the spaceships
+        if (!++queue->next_seq) {
+            queue->next_seq = 1;
+        }
+        sent++;
+        collect_acks(now_usec());
+    }
+
+    // The moves still queued are waited for at most two turns
+    sending_usec = now_usec() - start;
+    end = start + sending_usec + 2 * TURN_DURATION * 1000000L;
+    do {
+        now = now_usec();
+        collect_acks(now);
+        for (i = 0, lost = 0; i < N_TEAMS; i++) {
+            lost += pending[i].count;
+        }
+        usleep(LOADGEN_MAX_WAIT);
+    } while (lost && now < end);
+    for (i = 0; i < N_TEAMS; i++) {
+        accepted += pmap->admission[i].accepted;
+        dropped += pmap->admission[i].dropped;
+    }
+
+    qsort(latencies, n_latencies, sizeof(long), compare_long);
+    fprintf(stdout,
+            "[LOADGEN] %ld sent (%.1f moves/s), %ld rejected by full "
+            "queues, %ld acknowledged (%.1f moves/s), %ld never "
+            "acknowledged...\n",
+            sent,
+            sent * 1e6 / sending_usec,
+            full,
+            n_latencies,
+            n_latencies * 1e6 / (now - start),
+            lost);
+    fprintf(stdout,
+            "[LOADGEN] The simulator accepted %d moves and dropped %d, "
+            "counting every producer...\n",
+            accepted,
+            dropped);
+    fprintf(stdout,
+            "[LOADGEN] Latency in usec: p50 %ld, p90 %ld, p99 %ld, p99.9 %ld, "
+            "max %ld...\n",
+            percentile(0.5),
+            percentile(0.9),
+            percentile(0.99),
+            percentile(0.999),
+            percentile(1));
+
+    free_resources();
+
+    exit(EXIT_SUCCESS);
+}
+
+static status init_shared_resources()
+{
+    int i;
+
+    for (i = 0; i < N_TEAMS; i++) {
+        queues[i] = (mqd_t)-1;
+    }
+
+    if (!shm_region_attach(&shm_map,
+                           ipc_names.shm_map,
+                           sizeof(map_t),
+                           PROT_READ,
+                           SHM_PREFAULT)) {
+        perror("[LOADGEN] Error opening the shared memory...\n");
+        return ERROR;
+    }
+    pmap = (map_t*)shm_map.addr;
+
+    // Non blocking like the spaceships, a full queue is measured
+    for (i = 0; i < N_TEAMS; i++) {
+        queues[i] = mq_open(ipc_names.mq_actions[i], O_WRONLY | O_NONBLOCK);
+        if (queues[i] == (mqd_t)-1) {
+            perror("[LOADGEN] Error opening the queues...\n");
+            return ERROR;
+        }
+    }
+
+    return OK;
+}
+
+static void free_resources()
+{
+    int i;
+
+    for (i = 0; i < N_TEAMS; i++) {
+        if (queues[i] != (mqd_t)-1) {
+            mq_close(queues[i]);
+        }
+    }
+    shm_region_detach(&shm_map);
+    free(latencies);
+}
+
+/* A move of the virtual ship, as a spaceship of the map. There are only
+ * N_SPACESHIPS per team, so several virtual ships may share one and the
+ * simulator drops what exceeds its budget. The map is read without the
+ * lock: a stale position only makes the move blocked or missed. */
+static void build_move(move_t* move,
+                       int ship,
+                       int attacks,
+                       int hotspot,
+                       int hotspoty,
+                       int hotspotx,
+                       unsigned int* seed)
+{
+    spaceship_t spaceship;
+    int y, x;
+
+    memset(move, 0, sizeof(move_t));
+    move->team = ship % N_TEAMS;
+    move->id_spaceship = (ship / N_TEAMS) % N_SPACESHIPS;
+    spaceship = map_get_spaceship(pmap, move->team, move->id_spaceship);
+    move->originY = spaceship.posy;
+    move->originX = spaceship.posx;
+    move->turn = pmap->turn;
+    move->type = ((int)(rand_r(seed) % 100) < attacks) ? ATTACK : MOVE;
+
+    // The hotspot draws the attacks to its squares and the moves towards it
+    if ((int)(rand_r(seed) % 100) < hotspot) {
+        y = hotspoty + (int)(rand_r(seed) % (2 * LOADGEN_HOTSPOT_SIZE + 1)) -
+            LOADGEN_HOTSPOT_SIZE;
+        x = hotspotx + (int)(rand_r(seed) % (2 * LOADGEN_HOTSPOT_SIZE + 1)) -
+            LOADGEN_HOTSPOT_SIZE;
+    } else {
+        y = rand_r(seed) % MAP_MAX_Y;
+        x = rand_r(seed) % MAP_MAX_X;
+    }
+    if (move->type == MOVE) {
+        y = spaceship.posy + ((y > spaceship.posy) - (y < spaceship.posy));
+        x = spaceship.posx + ((x > spaceship.posx) - (x < spaceship.posx));
+    }
+    move->objetiveY = (y < 0) ? 0 : (y >= MAP_MAX_Y) ? MAP_MAX_Y - 1 : y;
+    move->objetiveX = (x < 0) ? 0 : (x >= MAP_MAX_X) ? MAP_MAX_X - 1 : x;
+}
+
+/* Queues are FIFO, so every move up to the last acknowledged one is out. */
+static void collect_acks(long now)
+{
+    int i;
+    unsigned int acked;
+    pending_t* queue;
+
+    for (i = 0; i < N_TEAMS; i++) {
+        queue = &pending[i];
+        acked = __atomic_load_n(&pmap->acked[i], __ATOMIC_ACQUIRE);
+        while (queue->count && (int)(acked - queue->seq[queue->first]) >= 0) {
+            if (n_latencies < max_latencies) {
+                latencies[n_latencies++] =
+                  now - queue->sent_usec[queue->first];
+            }
+            queue->first = (queue->first + 1) % LOADGEN_PENDING;
+            queue->count--;
+        }
+    }
+}
+
+static long now_usec()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000L + now.tv_nsec / 1000;
+}
+
+/* Of the sorted latencies, p in [0, 1]. */
+static long percentile(double p)
+{
+    long i;
+
+    if (!n_latencies) {
+        return 0;
+    }
+    i = (long)(p * n_latencies);
+
+    return latencies[(i < n_latencies) ? i : n_latencies - 1];
+}
+
+static int compare_long(const void* a, const void* b)
+{
+    long x = *(const long*)a, y = *(const long*)b;
+
+    return (x > y) - (x < y);
+}
@@ -0,0 +1,222 @@
+#include <stdbool.h> // bool
+#include <stdio.h>   // fprintf, perror
+#include <stdlib.h>  // exit, atoi, calloc
+#include <time.h>    // clock_gettime
+#include <unistd.h>  // getopt, sysconf
+
+#include "ai.h"
+#include "map.h"
+#include "simulator.h"
+
+#define MAPBENCH_TAKEN 10000       // Squares that are not empty
+#define MAPBENCH_LOOKUPS 10000000  // Random reads of a square
+#define MAPBENCH_POINTS (1 << 20)  // Random squares read in a loop
+#define MAPBENCH_CLUSTER_RADIUS 16 // Squares around the center of a cluster
+#define MAPBENCH_ROUNDS 10         // map_restore and hashes timed
+
+#ifdef MAP_SPARSE
+#define MAPBENCH_LAYOUT "sparse"
+#else
+#define MAPBENCH_LAYOUT "dense"
+#endif
+
+static long resident_kb();
+static long elapsed_nsec(struct timespec* start);
+
+int main(int argc, char* argv[])
+{
+    int i, j, opt, y, x, cy = 0, cx = 0;
+    int taken = MAPBENCH_TAKEN;
+    int clusters = 0;
+    int height = MAP_MAX_Y, width = MAP_MAX_X; // Playable area
+    bool fixed;
+    long lookups = MAPBENCH_LOOKUPS;
+    long l, found = 0, rss;
+    long init_nsec, fill_nsec, lookup_nsec, scan_nsec, restore_nsec;
+    long hash_nsec;
+    unsigned int seed = time(NULL);
+    int* points;
+    map_t* map;
+    struct timespec start;
+
+    while ((opt = getopt(argc, argv, "n:c:l:s:y:x:")) != -1) {
+        switch (opt) {
+            case 'n':
+                taken = atoi(optarg);
+                break;
+            case 'c':
+                clusters = atoi(optarg);
+                break;
+            case 'l':
+                lookups = atol(optarg);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            case 'y':
+                height = atoi(optarg);
+                break;
+            case 'x':
+                width = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr,
+                        "Usage: %s [-n squares] [-c clusters] [-l lookups] "
+                        "[-s seed] [-y rows] [-x columns]\n",
+                        argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (taken < 0 || clusters < 0 || lookups <= 0 || height <= 0 ||
+        height > MAP_MAX_Y || width <= 0 || width > MAP_MAX_X) {
+        fprintf(stderr, "[MAPBENCH] Invalid arguments...\n");
+        exit(EXIT_FAILURE);
+    }
+
+    points = malloc(2 * MAPBENCH_POINTS * sizeof(int));
+    map = calloc(1, sizeof(map_t));
+    if (!points || !map) {
+        perror("[MAPBENCH] Error allocating the map...\n");
+        exit(EXIT_FAILURE);
+    }
+    for (l = 0; l < MAPBENCH_POINTS; l++) {
+        points[2 * l] = ai_rand_interval(0, height - 1, &seed);
+        points[2 * l + 1] = ai_rand_interval(0, width - 1, &seed);
+    }
+    fixed = map_set_area(height, width);
+    rss = resident_kb();
+
+    // An empty map, as game_init_map leaves it before placing anything,
+    // with asteroids out of the playable area
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < MAP_MAX_Y; i++) {
+        for (j = 0; j < MAP_MAX_X; j++) {
+            map_clean_square(map, i, j);
+            if (i >= height || j >= width) {
+                map_set_asteroid(map, i, j);
+            }
+        }
+    }
+    init_nsec = elapsed_nsec(&start);
+
+    // Uniformly spread or around a few centers, as fleets gather
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < taken; i++) {
+        if (clusters && i % ((taken + clusters - 1) / clusters) == 0) {
+            cy = ai_rand_interval(0, height - 1, &seed);
+            cx = ai_rand_interval(0, width - 1, &seed);
+        }
+        if (clusters) {
+            y = cy + ai_rand_interval(0, 2 * MAPBENCH_CLUSTER_RADIUS, &seed) -
+                MAPBENCH_CLUSTER_RADIUS;
+            x = cx + ai_rand_interval(0, 2 * MAPBENCH_CLUSTER_RADIUS, &seed) -
+                MAPBENCH_CLUSTER_RADIUS;
+            y = (y < 0) ? 0 : (y >= height) ? height - 1 : y;
+            x = (x < 0) ? 0 : (x >= width) ? width - 1 : x;
+        } else {
+            y = ai_rand_interval(0, height - 1, &seed);
+            x = ai_rand_interval(0, width - 1, &seed);
+        }
+        map_set_asteroid(map, y, x);
+    }
+    fill_nsec = elapsed_nsec(&start);
+    rss = resident_kb() - rss;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (l = 0; l < lookups; l++) {
+        i = l & (MAPBENCH_POINTS - 1);
+        found += map_get_square(map, points[2 * i], points[2 * i + 1]).team !=
+                 -1;
+    }
+    lookup_nsec = elapsed_nsec(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < MAP_MAX_Y; i++) {
+        for (j = 0; j < MAP_MAX_X; j++) {
+            found += !map_is_square_empty(map, i, j);
+        }
+    }
+    scan_nsec = elapsed_nsec(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < MAPBENCH_ROUNDS; i++) {
+        map_restore(map);
+    }
+    restore_nsec = elapsed_nsec(&start) / MAPBENCH_ROUNDS;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < MAPBENCH_ROUNDS; i++) {
+        map_compute_hash(map);
+    }
+    hash_nsec = elapsed_nsec(&start) / MAPBENCH_ROUNDS;
+
+    fprintf(stdout,
+            "[MAPBENCH] %s %dx%d, %d squares taken in %d clusters...\n",
+            MAPBENCH_LAYOUT,
+            MAP_MAX_Y,
+            MAP_MAX_X,
+            taken,
+            clusters);
+    fprintf(stdout,
+            "[MAPBENCH] playable area %dx%d with %s kernels...\n",
+            height,
+            width,
+            fixed ? "fixed" : "generic");
+#ifdef MAP_SPARSE
+    fprintf(stdout,
+            "[MAPBENCH] %d chunks of %zu KB in use, %d squares lost...\n",
+            map->chunks_used,
+            sizeof(map_chunk_t) / 1024,
+            map->chunks_full);
+#endif
+    fprintf(stdout,
+            "[MAPBENCH] map_t %zu KB, %ld KB resident...\n",
+            sizeof(map_t) / 1024,
+            rss);
+    fprintf(stdout,
+            "[MAPBENCH] empty map %.3f ms, fill %.3f ms, map_restore %.3f "
+            "ms, map_compute_hash %.3f ms...\n",
+            init_nsec / 1e6,
+            fill_nsec / 1e6,
+            restore_nsec / 1e6,
+            hash_nsec / 1e6);
+    fprintf(stdout,
+            "[MAPBENCH] random map_get_square %.2f ns, scan %.2f ns per "
+            "square (%ld found)...\n",
+            (double)lookup_nsec / lookups,
+            (double)scan_nsec / ((long)MAP_MAX_Y * MAP_MAX_X),
+            found);
+
+    free(map);
+    free(points);
+
+    exit(EXIT_SUCCESS);
+}
+
+/* Resident set of the process from /proc. */
+static long resident_kb()
+{
+    FILE* f;
+    long size, resident = 0;
+
+    f = fopen("/proc/self/statm", "r");
+    if (!f) {
+        return 0;
+    }
+    if (fscanf(f, "%ld %ld", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(f);
+
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static long elapsed_nsec(struct timespec* start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1000000000L +
+           (now.tv_nsec - start->tv_nsec);
+}
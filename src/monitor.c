@@ -1,34 +1,144 @@
-#include <errno.h>     // errno
-#include <fcntl.h>     // O_* constants
-#include <semaphore.h> // sem_open
-#include <signal.h>    // sigaction
-#include <stdio.h>     // fprintf, perror
-#include <stdlib.h>    // exit
-#include <sys/mman.h>  // shm_open
-#include <unistd.h>    // usleep
+#define _GNU_SOURCE     // cpu_set_t
+#include <errno.h>      // errno
+#include <fcntl.h>      // O_* constants
+#include <poll.h>       // poll
+#include <semaphore.h>  // sem_open
+#include <signal.h>     // sigaction
+#include <stdio.h>      // fprintf, perror
+#include <stdlib.h>     // exit
+#include <string.h>     // strncpy
+#include <sys/mman.h>   // shm_open
+#include <sys/socket.h> // socket
+#include <sys/un.h>     // sockaddr_un
+#include <time.h>       // clock_gettime
+#include <unistd.h>     // usleep
 
+#include "affinity.h"
+#include "frame.h"
 #include "gamescreen.h"
+#include "ipc.h"
+#include "lod.h"
 #include "map.h"
+#include "notify.h"
+#include "observer.h"
+#include "rewind.h"
+#include "shm.h"
 #include "simulator.h"
 
-#define SCREEN_REFRESH 10000
+#define MONITOR_MAX_FPS 30 // Frames per second drawn at most
 
 extern char team_symbols[N_TEAMS];
 
-int fd_shm_map;          // Shared memory with the map
-map_t* pmap = NULL;      // pointer to the map
-sem_t* sem_ready = NULL; // semapore for monitor process
+ipc_names_t ipc_names;    // Names of the resources of the instance
+shm_region_t shm_map;     // Shared memory with the map
+map_t* pmap = NULL;       // pointer to the map
+sem_t* sem_ready = NULL;  // semapore for monitor process
+int fd_observer = -1;     // connection with the observer
+notify_t notify = { -1 }; // Wakes us when the simulator commits a change
+lod_t lod;                // Summary of the map for every zoom level
+int view_level = 0;       // Zoom, a screen cell shows 2^level squares a side
+int view_y = 0;           // Map row at the top of the screen
+int view_x = 0;           // Map column at the left of the screen
+shm_region_t shm_rewind;  // Shared memory with the last turns
+rewind_t* prewind = NULL; // Last turns, NULL if they cannot be read
+int view_turn = -1;       // Turn on the screen, -1 for the live map
+
+static map_t snapshot; // Map of view_turn
 
 static status init_shared_resources();
+static status init_observer(char* path, observer_roi_t* roi);
 static void free_resources();
 static void print_map(map_t* ptipo_mapa);
+static void read_keys();
+static map_t* shown_map();
+static map_t* attach_map();
+static long elapsed_usec(struct timespec* start);
 static void handler_SIGINT(int signal);
+static bool read_observer(map_t* map);
 
 int main(int argc, char* argv[])
 {
     int i;
     int teams_alive;
-    int winner;
+    int winner = -1;
+    int opt;
+    char* observer_path = NULL;
+    char* instance = NULL;
+    observer_roi_t roi = { 0, 0, -1, -1 };
+    long frame_usec = 1000000L / MONITOR_MAX_FPS;
+    long wait;
+    struct timespec drawn;
+    struct pollfd fds[2];
+
+    while ((opt = getopt(argc, argv, "i:f:o:R:")) != -1) {
+        switch (opt) {
+            case 'i':
+                instance = optarg;
+                break;
+            case 'f':
+                if (atoi(optarg) <= 0) {
+                    fprintf(stderr, "[MONITOR] Invalid frame rate...\n");
+                    exit(EXIT_FAILURE);
+                }
+                frame_usec = 1000000L / atoi(optarg);
+                break;
+            case 'o':
+                observer_path = optarg;
+                break;
+            case 'R':
+                if (sscanf(optarg,
+                           "%d,%d,%d,%d",
+                           &roi.x0,
+                           &roi.y0,
+                           &roi.x1,
+                           &roi.y1) != 4) {
+                    fprintf(stderr, "[MONITOR] Region must be x0,y0,x1,y1\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                fprintf(stderr,
+                        "Usage: %s [-i instance] [-f max_fps] "
+                        "[-o observer_socket [-R x0,y0,x1,y1]]\n",
+                        argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!ipc_names_init(&ipc_names, instance)) {
+        fprintf(stderr, "[MONITOR] Invalid instance id...\n");
+        exit(EXIT_FAILURE);
+    }
+    if (!lod_init(&lod)) {
+        perror("[MONITOR] Error allocating the zoom levels...\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (observer_path) {
+        // Remote view: the map is rebuilt from the frames of the observer
+        if (!init_observer(observer_path, &roi)) {
+            free_resources();
+            exit(EXIT_FAILURE);
+        }
+        screen_init();
+        while (read_observer(pmap)) {
+            print_map(pmap);
+        }
+        screen_end();
+        for (i = 0, teams_alive = 0; i < N_TEAMS; i++) {
+            if (map_get_num_spaceships(pmap, i)) {
+                teams_alive++;
+                winner = i;
+            }
+        }
+        // Out of a region the spaceships arrive as destroyed, so the winner
+        // is only known with the whole map
+        if (teams_alive == 1 && (roi.x1 < 0 || roi.y1 < 0)) {
+            fprintf(stdout, "[MONITOR] Winner: %c...\n", team_symbols[winner]);
+        }
+        free_resources();
+        exit(EXIT_SUCCESS);
+    }
 
     // init resources
     if (!init_shared_resources()) {
@@ -36,35 +146,61 @@ int main(int argc, char* argv[])
         exit(EXIT_FAILURE);
     }
 
-    // Send the signal to the main process that monitor is ready
+    // Only a simulator started with -W waits for this signal
     sem_post(sem_ready);
 
     screen_init();
 
+    // The simulator may be in the middle of a turn, so the first frame is
+    // the last turn it committed
+    print_map(attach_map());
+    clock_gettime(CLOCK_MONOTONIC, &drawn);
+
     // Main loop
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[1].fd = notify.fd;
+    fds[1].events = POLLIN;
     while (1) {
-        // We dont need to control the access to map because in case that
-        // the monitor shows wrong information about the map it will be
-        // refreshed in 0.01 secs.
-        print_map(pmap);
-        usleep(SCREEN_REFRESH);
+        // Sleep until a commit or a key, and then for the rest of the frame
+        // so the commits meanwhile are drawn together
+        if (poll(fds, 2, -1) == -1 && errno != EINTR) {
+            perror("[MONITOR] poll");
+            break;
+        }
+        wait = frame_usec - elapsed_usec(&drawn);
+        if (wait > 0) {
+            usleep(wait);
+        }
+        notify_clear(&notify);
 
-        // Check if there is a winner
-        for (i = 0, teams_alive = 0; i < N_TEAMS; i++) {
+        // We dont need to control the access to map because the commits are
+        // notified after the lock is released, so a frame read in the middle
+        // of a change is redrawn when that change is notified.
+        print_map(shown_map());
+        clock_gettime(CLOCK_MONOTONIC, &drawn);
+
+        // Check if there is a winner, or a draw if SPLASH destroyed the
+        // last spaceships of every team at once
+        for (i = 0, teams_alive = 0, winner = -1; i < N_TEAMS; i++) {
             if (map_get_num_spaceships(pmap, i)) {
                 teams_alive++;
                 winner = i;
             }
         }
 
-        if (teams_alive == 1) {
+        if (teams_alive <= 1) {
             break;
         }
     }
 
     screen_end();
 
-    fprintf(stdout, "[MONITOR] Winner: %c...\n", team_symbols[winner]);
+    if (winner >= 0) {
+        fprintf(stdout, "[MONITOR] Winner: %c...\n", team_symbols[winner]);
+    } else {
+        fprintf(stdout, "[MONITOR] Draw...\n");
+    }
     free_resources();
 
     exit(EXIT_SUCCESS);
@@ -75,26 +211,42 @@ static status init_shared_resources()
     struct sigaction act;
 
     // Semaphores
-    sem_ready = sem_open(SEM_READY_NAME, O_RDWR);
+    sem_ready = sem_open(ipc_names.sem_ready, O_RDWR);
     if (sem_ready == SEM_FAILED) {
         perror("[MONITOR] Error opening the semaphore sem_ready...\n");
         return ERROR;
     }
 
     // Shared memory
-    fd_shm_map = shm_open(SHM_MAP_NAME, O_RDONLY, 0);
-    if (fd_shm_map == -1) {
+    if (!shm_region_attach(&shm_map,
+                           ipc_names.shm_map,
+                           sizeof(map_t),
+                           PROT_READ,
+                           SHM_PREFAULT)) {
         perror("[MONITOR] Error opening the shared memory...\n");
         return ERROR;
     }
+    pmap = (map_t*)shm_map.addr;
 
-    pmap =
-      (map_t*)mmap(NULL, sizeof(map_t), PROT_READ, MAP_SHARED, fd_shm_map, 0);
-    if (pmap == MAP_FAILED) {
-        perror("[MONITOR] Error mapping the shared memory...\n");
+    // Without the last turns there is only the live map
+    if (shm_region_attach(&shm_rewind,
+                          ipc_names.shm_rewind,
+                          sizeof(rewind_t),
+                          PROT_READ,
+                          0)) {
+        prewind = (rewind_t*)shm_rewind.addr;
+    }
+
+    if (!notify_open(&notify, pmap)) {
+        perror("[MONITOR] Error waiting for the commits of the map...\n");
         return ERROR;
     }
 
+    // The simulator keeps a core for us when it runs pinned
+    if (pmap->monitor_cpu >= 0 && !affinity_pin_cpu(pmap->monitor_cpu)) {
+        perror("[MONITOR] Error pinning the monitor...\n");
+    }
+
     // Signals
     sigemptyset(&(act.sa_mask));
     act.sa_flags = 0;
@@ -107,25 +259,245 @@ static status init_shared_resources()
     return OK;
 }
 
+static status init_observer(char* path, observer_roi_t* roi)
+{
+    struct sigaction act;
+    struct sockaddr_un addr;
+
+    pmap = calloc(1, sizeof(map_t));
+    if (!pmap) {
+        perror("[MONITOR] calloc");
+        return ERROR;
+    }
+
+    fd_observer = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_observer == -1) {
+        perror("[MONITOR] Error creating the socket...\n");
+        return ERROR;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    if (connect(fd_observer, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        perror("[MONITOR] Error connecting to the observer...\n");
+        return ERROR;
+    }
+
+    if (write(fd_observer, roi, sizeof(observer_roi_t)) !=
+        sizeof(observer_roi_t)) {
+        perror("[MONITOR] Error subscribing to the observer...\n");
+        return ERROR;
+    }
+
+    // Signals
+    sigemptyset(&(act.sa_mask));
+    act.sa_flags = 0;
+    act.sa_handler = handler_SIGINT;
+    if (sigaction(SIGINT, &act, NULL) < 0) {
+        perror("[MONITOR] Error establishing the handler for SIGINT...\n");
+        return ERROR;
+    }
+
+    return OK;
+}
+
 static void free_resources()
 {
+    lod_free(&lod);
+    if (fd_observer >= 0) {
+        close(fd_observer);
+        free(pmap);
+        return;
+    }
     sem_close(sem_ready);
-    munmap(pmap, sizeof(map_t));
+    notify_close(&notify);
+    shm_region_detach(&shm_rewind);
+    shm_region_detach(&shm_map);
 }
 
+static bool read_observer(map_t* map)
+{
+    observer_msg_t msg;
+    unsigned char frame[FRAME_MAX_SIZE];
+
+    if (recv(fd_observer, &msg, sizeof(msg), MSG_WAITALL) != sizeof(msg) ||
+        msg.len > FRAME_MAX_SIZE ||
+        recv(fd_observer, frame, msg.len, MSG_WAITALL) != msg.len) {
+        return false;
+    }
+
+    return frame_apply(map, msg.type, frame, msg.len);
+}
+
+/* Draws the part of the map in the viewport. Zoomed out, each screen cell
+ * summarises a block of squares from the pyramid, so the cost depends on the
+ * size of the terminal and not on the size of the map. */
 static void print_map(map_t* ptipo_mapa)
 {
     int i, j;
+    int rows, cols, row0, col0;
+    char symbol;
+    char status_line[160];
 
-    for (j = 0; j < MAP_MAX_Y; j++) {
-        for (i = 0; i < MAP_MAX_X; i++) {
-            square_t square = map_get_square(ptipo_mapa, j, i);
-            screen_addch(i, j, square.symbol);
+    read_keys();
+    lod_update(&lod, ptipo_mapa);
+
+    screen_size(&rows, &cols);
+    rows--; // Last line for the status
+    row0 = view_y >> view_level;
+    col0 = view_x >> view_level;
+    for (i = 0; i < rows && row0 + i < lod.height[view_level]; i++) {
+        for (j = 0; j < cols && col0 + j < lod.width[view_level]; j++) {
+            if (view_level == 0) {
+                // Full detail shows missiles and impacts too
+                symbol = map_get_symbol(ptipo_mapa, row0 + i, col0 + j);
+            } else {
+                symbol =
+                  lod_symbol(lod_get(&lod, view_level, row0 + i, col0 + j));
+            }
+            screen_addch(i, j, symbol);
         }
     }
+
+    snprintf(status_line,
+             sizeof(status_line),
+             "Turn %d%s  Zoom 1:%d  Row %d  Col %d  [hjkl/arrows +/-%s]   ",
+             ptipo_mapa->turn,
+             (view_turn >= 0) ? " REWIND" : "",
+             1 << view_level,
+             view_y,
+             view_x,
+             prewind ? " []" : "");
+    if ((int)strlen(status_line) > cols) {
+        status_line[cols > 0 ? cols : 0] = '\0';
+    }
+    screen_addstr(rows, 0, status_line);
     screen_refresh();
 }
 
+/* Pans the viewport one screen cell, changes the zoom or steps through the
+ * last turns. */
+static void read_keys()
+{
+    int key;
+    int step, rows, cols;
+    int oldest, newest;
+    int height, width;
+    bool changed = false;
+
+    while ((key = screen_getch()) != -1) {
+        step = 1 << view_level;
+        switch (key) {
+            case 'h':
+                view_x -= step;
+                break;
+            case 'l':
+                view_x += step;
+                break;
+            case 'k':
+                view_y -= step;
+                break;
+            case 'j':
+                view_y += step;
+                break;
+            case '-':
+                if (view_level < lod.n_levels - 1) {
+                    view_level++;
+                }
+                break;
+            case '+':
+                if (view_level > 0) {
+                    view_level--;
+                }
+                break;
+            case '[':
+                // From the live map to the start of the current turn
+                if (!prewind || !rewind_range(prewind, &oldest, &newest)) {
+                    continue;
+                }
+                view_turn = (view_turn < 0) ? newest : view_turn - 1;
+                view_turn = (view_turn < oldest) ? oldest : view_turn;
+                break;
+            case ']':
+                // Past the newest turn kept comes the live map
+                if (view_turn < 0 ||
+                    !rewind_range(prewind, &oldest, &newest)) {
+                    continue;
+                }
+                view_turn = (view_turn < newest) ? view_turn + 1 : -1;
+                break;
+            default:
+                continue;
+        }
+        changed = true;
+    }
+    if (!changed) {
+        return;
+    }
+
+    // Keep the viewport inside the playable area, on whole cells of the
+    // zoom level. The maps rebuilt from an observer do not know it.
+    height = (pmap->height > 0) ? pmap->height : MAP_MAX_Y;
+    width = (pmap->width > 0) ? pmap->width : MAP_MAX_X;
+    screen_size(&rows, &cols);
+    rows--;
+    step = 1 << view_level;
+    if (view_x > width - cols * step) {
+        view_x = width - cols * step;
+    }
+    if (view_y > height - rows * step) {
+        view_y = height - rows * step;
+    }
+    view_x = (view_x < 0) ? 0 : view_x & ~(step - 1);
+    view_y = (view_y < 0) ? 0 : view_y & ~(step - 1);
+    screen_clear();
+}
+
+/* The live map, or the snapshot of view_turn while rewinding. A turn that
+ * was dropped meanwhile moves the view to the oldest one kept. */
+static map_t* shown_map()
+{
+    int oldest, newest;
+
+    if (view_turn < 0) {
+        return pmap;
+    }
+    if (rewind_range(prewind, &oldest, &newest) && view_turn < oldest) {
+        view_turn = oldest;
+    }
+    if (rewind_read(prewind, view_turn, &snapshot)) {
+        return &snapshot;
+    }
+    view_turn = -1;
+
+    return pmap;
+}
+
+/* The newest turn kept for rewind, copied under its sequence counter so it
+ * is consistent while the simulator writes. The live map if there is none. */
+static map_t* attach_map()
+{
+    int oldest, newest;
+
+    if (prewind && rewind_range(prewind, &oldest, &newest) &&
+        rewind_read(prewind, newest, &snapshot)) {
+        return &snapshot;
+    }
+
+    return pmap;
+}
+
+static long elapsed_usec(struct timespec* start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1000000L +
+           (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
 static void handler_SIGINT(int signal)
 {
     screen_end();
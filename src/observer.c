@@ -0,0 +1,514 @@
+#include <errno.h>      // errno
+#include <fcntl.h>      // O_* constants
+#include <poll.h>       // poll
+#include <signal.h>     // sigaction
+#include <stdio.h>      // fprintf, perror
+#include <stdlib.h>     // exit
+#include <string.h>     // memcpy, strncpy
+#include <sys/mman.h>   // shm_open
+#include <sys/socket.h> // socket
+#include <sys/un.h>     // sockaddr_un
+#include <time.h>       // clock_gettime
+#include <unistd.h>     // close, unlink
+
+#include "frame.h"
+#include "ipc.h"
+#include "map.h"
+#include "notify.h"
+#include "observer.h"
+#include "rewind.h"
+#include "shm.h"
+#include "simulator.h"
+
+typedef struct {
+    int fd;                                  // -1 if the slot is free
+    observer_roi_t roi;                      // Squares the client wants
+    spaceship_t sent[N_TEAMS][N_SPACESHIPS]; // State the client has
+    bool resync;                             // Next message is a keyframe
+    int stalls;                              // Turns skipped in a row
+    unsigned char in[sizeof(observer_roi_t)]; // Subscription being read
+    size_t in_len;
+    unsigned char out[OBSERVER_MSG_MAX_SIZE];
+    size_t out_len;
+    size_t out_off;
+} client_t;
+
+ipc_names_t ipc_names;    // Names of the resources of the instance
+shm_region_t shm_map;     // Shared memory with the map
+map_t* pmap = NULL;       // pointer to the map
+notify_t notify = { -1 }; // Wakes us when the simulator commits a change
+shm_region_t shm_rewind;  // Shared memory with the last turns
+rewind_t* prewind = NULL; // Last turns, the source of what is sent
+int fd_listen = -1;       // socket for new clients
+char* socket_path = NULL;
+char default_path[sizeof(OBSERVER_SOCKET_INSTANCE) + IPC_MAX_INSTANCE];
+client_t clients[OBSERVER_MAX_CLIENTS];
+
+static map_t committed;         // Newest turn read from the ring
+static int committed_turn = -1; // Its turn, -1 before the first read
+static uint64_t roi_terrain[MAP_VISIBLE_WORDS]; // Asteroids of a region
+
+static status init_shared_resources();
+static void free_resources();
+static void handler_SIGINT(int signal);
+static bool take_snapshot(spaceship_t ships[N_TEAMS][N_SPACESHIPS], int* turn);
+static void accept_client();
+static void read_client(client_t* client);
+static void flush_client(client_t* client);
+static void drop_client(client_t* client);
+static void flush_all();
+static void publish(client_t* client,
+                    spaceship_t ships[N_TEAMS][N_SPACESHIPS],
+                    int turn);
+static bool in_roi(observer_roi_t* roi, int posy, int posx);
+
+int main(int argc, char* argv[])
+{
+    int i, n;
+    int opt;
+    int turn, last_turn = -1;
+    int teams_alive;
+    bool game_over = false;
+    spaceship_t ships[N_TEAMS][N_SPACESHIPS];
+    struct pollfd fds[OBSERVER_MAX_CLIENTS + 2];
+    client_t* polled[OBSERVER_MAX_CLIENTS + 2];
+
+    char* instance = NULL;
+
+    while ((opt = getopt(argc, argv, "i:s:")) != -1) {
+        switch (opt) {
+            case 'i':
+                instance = optarg;
+                break;
+            case 's':
+                socket_path = optarg;
+                break;
+            default:
+                fprintf(
+                  stderr, "Usage: %s [-i instance] [-s socket]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (!ipc_names_init(&ipc_names, instance)) {
+        fprintf(stderr, "[OBSERVER] Invalid instance id...\n");
+        exit(EXIT_FAILURE);
+    }
+    if (!socket_path) {
+        if (ipc_names.instance[0]) {
+            snprintf(default_path,
+                     sizeof(default_path),
+                     OBSERVER_SOCKET_INSTANCE,
+                     ipc_names.instance);
+            socket_path = default_path;
+        } else {
+            socket_path = OBSERVER_SOCKET;
+        }
+    }
+
+    for (i = 0; i < OBSERVER_MAX_CLIENTS; i++) {
+        clients[i].fd = -1;
+    }
+
+    if (!init_shared_resources()) {
+        free_resources();
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stdout, "[OBSERVER] Serving the map on %s...\n", socket_path);
+    while (!game_over) {
+        // Wait for clients or a commit of the map
+        fds[0].fd = fd_listen;
+        fds[0].events = POLLIN;
+        polled[0] = NULL;
+        fds[1].fd = notify.fd;
+        fds[1].events = POLLIN;
+        polled[1] = NULL;
+        for (i = 0, n = 2; i < OBSERVER_MAX_CLIENTS; i++) {
+            if (clients[i].fd < 0) {
+                continue;
+            }
+            fds[n].fd = clients[i].fd;
+            fds[n].events = POLLIN;
+            if (clients[i].out_off < clients[i].out_len) {
+                fds[n].events |= POLLOUT;
+            }
+            polled[n++] = &clients[i];
+        }
+        if (poll(fds, n, -1) == -1 && errno != EINTR) {
+            perror("[OBSERVER] poll");
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            accept_client();
+        }
+        if (fds[1].revents & POLLIN) {
+            notify_clear(&notify);
+        }
+        for (i = 2; i < n; i++) {
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                read_client(polled[i]);
+            }
+            if (polled[i]->fd >= 0 && (fds[i].revents & POLLOUT)) {
+                flush_client(polled[i]);
+            }
+        }
+
+        // Send the new turn to every client
+        if (!take_snapshot(ships, &turn)) {
+            continue;
+        }
+        for (i = 0; i < OBSERVER_MAX_CLIENTS; i++) {
+            if (clients[i].fd >= 0 &&
+                (turn != last_turn || clients[i].resync)) {
+                publish(&clients[i], ships, turn);
+            }
+        }
+        last_turn = turn;
+
+        for (i = 0, teams_alive = 0; i < N_TEAMS; i++) {
+            if (map_get_num_spaceships(&committed, i)) {
+                teams_alive++;
+            }
+        }
+        game_over = teams_alive <= 1;
+    }
+
+    // Let the clients get the last turn
+    flush_all();
+
+    fprintf(stdout, "[OBSERVER] End of the battle...\n");
+    free_resources();
+
+    exit(EXIT_SUCCESS);
+}
+
+static status init_shared_resources()
+{
+    int fd;
+    struct sigaction act;
+    struct sockaddr_un addr;
+
+    // Shared memory
+    if (!shm_region_attach(&shm_map,
+                           ipc_names.shm_map,
+                           sizeof(map_t),
+                           PROT_READ,
+                           SHM_PREFAULT)) {
+        perror("[OBSERVER] Error opening the shared memory...\n");
+        return ERROR;
+    }
+    pmap = (map_t*)shm_map.addr;
+    if (!notify_open(&notify, pmap)) {
+        perror("[OBSERVER] Error waiting for the commits of the map...\n");
+        return ERROR;
+    }
+    if (!shm_region_attach(&shm_rewind,
+                           ipc_names.shm_rewind,
+                           sizeof(rewind_t),
+                           PROT_READ,
+                           0)) {
+        perror("[OBSERVER] Error opening the rewind buffer...\n");
+        return ERROR;
+    }
+    prewind = (rewind_t*)shm_rewind.addr;
+
+    // Socket
+    fd_listen = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd_listen == -1) {
+        perror("[OBSERVER] Error creating the socket...\n");
+        return ERROR;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    // The socket of an observer still running is not taken over, only the
+    // one left by an observer that died
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd != -1 &&
+        connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+        fprintf(stderr,
+                "[OBSERVER] Another observer is serving on %s...\n",
+                socket_path);
+        close(fd);
+        socket_path = NULL;
+        return ERROR;
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    unlink(socket_path);
+    if (bind(fd_listen, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+        listen(fd_listen, OBSERVER_MAX_CLIENTS) == -1) {
+        perror("[OBSERVER] Error binding the socket...\n");
+        return ERROR;
+    }
+
+    // Signals
+    sigemptyset(&(act.sa_mask));
+    act.sa_flags = 0;
+    act.sa_handler = handler_SIGINT;
+    if (sigaction(SIGINT, &act, NULL) < 0) {
+        perror("[OBSERVER] Error establishing the handler for SIGINT...\n");
+        return ERROR;
+    }
+
+    // A client that leaves is detected by send, not by a signal
+    act.sa_handler = SIG_IGN;
+    if (sigaction(SIGPIPE, &act, NULL) < 0) {
+        perror("[OBSERVER] Error establishing the handler for SIGPIPE...\n");
+        return ERROR;
+    }
+
+    return OK;
+}
+
+static void free_resources()
+{
+    int i;
+
+    for (i = 0; i < OBSERVER_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0) {
+            drop_client(&clients[i]);
+        }
+    }
+    if (fd_listen >= 0) {
+        close(fd_listen);
+        // Not ours if another observer was serving on it
+        if (socket_path) {
+            unlink(socket_path);
+        }
+    }
+    notify_close(&notify);
+    shm_region_detach(&shm_rewind);
+    shm_region_detach(&shm_map);
+}
+
+static void handler_SIGINT(int signal)
+{
+    free_resources();
+    exit(EXIT_SUCCESS);
+}
+
+static bool take_snapshot(spaceship_t ships[N_TEAMS][N_SPACESHIPS], int* turn)
+{
+    int oldest, newest;
+
+    // The live map changes with every move of a turn, so we send the turns
+    // kept for rewind, copied under their sequence counter. The simulator
+    // never waits for us.
+    if (!rewind_range(prewind, &oldest, &newest)) {
+        return false;
+    }
+    if (newest != committed_turn) {
+        if (!rewind_read(prewind, newest, &committed)) {
+            return false;
+        }
+        committed_turn = newest;
+    }
+    *turn = committed_turn;
+    memcpy(ships, committed.spaceships, sizeof(committed.spaceships));
+
+    return true;
+}
+
+static void accept_client()
+{
+    int i, fd;
+
+    fd = accept(fd_listen, NULL, NULL);
+    if (fd == -1) {
+        return;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    for (i = 0; i < OBSERVER_MAX_CLIENTS; i++) {
+        if (clients[i].fd < 0) {
+            break;
+        }
+    }
+    if (i == OBSERVER_MAX_CLIENTS) {
+        fprintf(stderr, "[OBSERVER] Too many clients...\n");
+        close(fd);
+        return;
+    }
+
+    memset(&clients[i], 0, sizeof(client_t));
+    clients[i].fd = fd;
+    clients[i].roi.x1 = -1;
+    clients[i].resync = true;
+    fprintf(stdout, "[OBSERVER] New client %d...\n", fd);
+}
+
+/* Reads the subscriptions of a client. A socket may return part of one, so
+ * it is kept until the rest arrives. */
+static void read_client(client_t* client)
+{
+    ssize_t n;
+
+    while ((n = recv(client->fd,
+                     client->in + client->in_len,
+                     sizeof(client->in) - client->in_len,
+                     0)) > 0) {
+        client->in_len += n;
+        if (client->in_len == sizeof(client->in)) {
+            memcpy(&client->roi, client->in, sizeof(observer_roi_t));
+            client->in_len = 0;
+            client->resync = true;
+        }
+    }
+    if (n == 0 ||
+        (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        drop_client(client);
+    }
+}
+
+static void flush_client(client_t* client)
+{
+    ssize_t n;
+
+    while (client->out_off < client->out_len) {
+        n = send(client->fd,
+                 client->out + client->out_off,
+                 client->out_len - client->out_off,
+                 MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                drop_client(client);
+            }
+            return;
+        }
+        client->out_off += n;
+    }
+}
+
+/* Sends what the clients have pending for at most OBSERVER_FLUSH_MSEC, so a
+ * client that does not read cannot keep us running. The ones that did not
+ * get everything are dropped. */
+static void flush_all()
+{
+    int i, n;
+    long left = OBSERVER_FLUSH_MSEC;
+    struct pollfd fds[OBSERVER_MAX_CLIENTS];
+    client_t* polled[OBSERVER_MAX_CLIENTS];
+    struct timespec start, now;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (left > 0) {
+        for (i = 0, n = 0; i < OBSERVER_MAX_CLIENTS; i++) {
+            if (clients[i].fd >= 0 &&
+                clients[i].out_off < clients[i].out_len) {
+                fds[n].fd = clients[i].fd;
+                fds[n].events = POLLOUT;
+                polled[n++] = &clients[i];
+            }
+        }
+        if (!n) {
+            return;
+        }
+        if (poll(fds, n, left) == -1 && errno != EINTR) {
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            if (fds[i].revents & (POLLOUT | POLLHUP | POLLERR)) {
+                flush_client(polled[i]);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        left = OBSERVER_FLUSH_MSEC - ((now.tv_sec - start.tv_sec) * 1000L +
+                                      (now.tv_nsec - start.tv_nsec) / 1000000);
+    }
+
+    for (i = 0; i < OBSERVER_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0 && clients[i].out_off < clients[i].out_len) {
+            fprintf(stderr,
+                    "[OBSERVER] Client %d did not get the last turn...\n",
+                    clients[i].fd);
+            drop_client(&clients[i]);
+        }
+    }
+}
+
+static void drop_client(client_t* client)
+{
+    fprintf(stdout, "[OBSERVER] Client %d gone...\n", client->fd);
+    close(client->fd);
+    client->fd = -1;
+}
+
+static void publish(client_t* client,
+                    spaceship_t ships[N_TEAMS][N_SPACESHIPS],
+                    int turn)
+{
+    int i, j, y, x, bit;
+    spaceship_t view[N_TEAMS][N_SPACESHIPS];
+    observer_msg_t msg;
+    observer_roi_t* roi = &client->roi;
+    uint64_t* terrain = committed.terrain;
+
+    // The client is still sending an older turn: skip this one and send a
+    // keyframe when it catches up, or drop it if it never does
+    if (client->out_off < client->out_len) {
+        client->resync = true;
+        if (++client->stalls > OBSERVER_MAX_STALLS) {
+            fprintf(stderr, "[OBSERVER] Client %d too slow...\n", client->fd);
+            drop_client(client);
+        }
+        return;
+    }
+    client->stalls = 0;
+
+    for (i = 0; i < N_TEAMS; i++) {
+        for (j = 0; j < N_SPACESHIPS; j++) {
+            view[i][j] = ships[i][j];
+            if (!in_roi(roi, ships[i][j].posy, ships[i][j].posx)) {
+                view[i][j].alive = false;
+                view[i][j].posx = view[i][j].posy = 0;
+                view[i][j].health = OBSERVER_HIDDEN;
+            }
+        }
+    }
+
+    if (client->resync) {
+        // Only the asteroids of the region
+        if (roi->x1 >= 0 && roi->y1 >= 0) {
+            memset(roi_terrain, 0, sizeof(roi_terrain));
+            for (y = (roi->y0 < 0) ? 0 : roi->y0;
+                 y <= roi->y1 && y < MAP_MAX_Y;
+                 y++) {
+                for (x = (roi->x0 < 0) ? 0 : roi->x0;
+                     x <= roi->x1 && x < MAP_MAX_X;
+                     x++) {
+                    bit = y * MAP_MAX_X + x;
+                    roi_terrain[bit / 64] |=
+                      committed.terrain[bit / 64] & (1ULL << (bit % 64));
+                }
+            }
+            terrain = roi_terrain;
+        }
+        msg.type = FRAME_KEY;
+        msg.len = frame_encode_key(view, terrain, client->out + sizeof(msg));
+        client->resync = false;
+    } else {
+        msg.type = FRAME_DELTA;
+        msg.len =
+          frame_encode_delta(client->sent, view, client->out + sizeof(msg));
+    }
+    msg.turn = turn;
+    memcpy(client->out, &msg, sizeof(msg));
+    memcpy(client->sent, view, sizeof(view));
+    client->out_len = sizeof(msg) + msg.len;
+    client->out_off = 0;
+
+    flush_client(client);
+}
+
+static bool in_roi(observer_roi_t* roi, int posy, int posx)
+{
+    if (roi->x1 < 0 || roi->y1 < 0) {
+        return true;
+    }
+
+    return posx >= roi->x0 && posx <= roi->x1 && posy >= roi->y0 &&
+           posy <= roi->y1;
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>  // fprintf, printf
+#include <stdlib.h> // exit, calloc
+#include <unistd.h> // usleep, getopt
+
+#include "gamescreen.h"
+#include "map.h"
+#include "recorder.h"
+#include "simulator.h"
+
+#define REPLAY_TURN_DELAY 500000 // Time each turn is shown on screen
+
+static void print_map(map_t* map);
+static void dump_map(map_t* map, int turn);
+
+int main(int argc, char* argv[])
+{
+    replay_t replay;
+    map_t* map;
+    int turn, opt;
+    bool check = false;
+
+    while ((opt = getopt(argc, argv, "c")) != -1) {
+        switch (opt) {
+            case 'c':
+                check = true;
+                break;
+            default:
+                optind = argc;
+                break;
+        }
+    }
+    if (argc - optind != 1 && argc - optind != 2) {
+        fprintf(stderr, "Usage: %s [-c] <recording> [turn]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    map = calloc(1, sizeof(map_t));
+    if (!map) {
+        perror("[REPLAY] calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!replay_open(&replay, argv[optind])) {
+        free(map);
+        exit(EXIT_FAILURE);
+    }
+
+    if (check) {
+        // Replay every turn as fast as possible comparing the hashes
+        while (replay_next(&replay, map)) {
+        }
+        if (replay.diverged >= 0) {
+            fprintf(stdout,
+                    "[REPLAY] Diverged from the recording at turn %d...\n",
+                    replay.diverged);
+            replay_close(&replay);
+            free(map);
+            exit(EXIT_FAILURE);
+        }
+        fprintf(stdout,
+                "[REPLAY] %d turns match the recording, final hash "
+                "%016llx...\n",
+                replay.turn + 1,
+                (unsigned long long)map->hash);
+    } else if (argc - optind == 2) {
+        // Dump a single turn
+        turn = atoi(argv[optind + 1]);
+        if (!replay_seek(&replay, map, turn)) {
+            fprintf(stderr, "[REPLAY] Turn %d is not recorded...\n", turn);
+            replay_close(&replay);
+            free(map);
+            exit(EXIT_FAILURE);
+        }
+        dump_map(map, turn);
+    } else {
+        screen_init();
+        while (replay_next(&replay, map)) {
+            print_map(map);
+            usleep(REPLAY_TURN_DELAY);
+        }
+        screen_end();
+        fprintf(stdout, "[REPLAY] %d turns played...\n", replay.turn + 1);
+    }
+
+    replay_close(&replay);
+    free(map);
+
+    exit(EXIT_SUCCESS);
+}
+
+static void print_map(map_t* map)
+{
+    int i, j;
+
+    for (i = 0; i < MAP_MAX_Y; i++) {
+        for (j = 0; j < MAP_MAX_X; j++) {
+            screen_addch(i, j, map_get_symbol(map, i, j));
+        }
+    }
+    screen_refresh();
+}
+
+static void dump_map(map_t* map, int turn)
+{
+    int i, j;
+
+    fprintf(stdout,
+            "[REPLAY] Turn %d, hash %016llx\n",
+            turn,
+            (unsigned long long)map->hash);
+    for (i = 0; i < MAP_MAX_Y; i++) {
+        for (j = 0; j < MAP_MAX_X; j++) {
+            putchar(map_get_symbol(map, i, j));
+        }
+        putchar('\n');
+    }
+}
@@ -1,30 +1,67 @@
-#include <errno.h>     // errno
-#include <fcntl.h>     // O_* constants
-#include <mqueue.h>    // mq_open
-#include <semaphore.h> // sem_open
-#include <signal.h>    // sigaction
-#include <stdio.h>     // fprintf, perror
-#include <stdlib.h>    // exit
-#include <sys/mman.h>  // shm_open
-#include <time.h>      // time
-#include <unistd.h>    // fork, alarm, execl, write
-#include <wait.h>      // wait
-
+#define _GNU_SOURCE       // cpu_set_t
+#include <errno.h>        // errno
+#include <fcntl.h>        // O_* constants
+#include <mqueue.h>       // mq_open
+#include <poll.h>         // poll
+#include <semaphore.h>    // sem_open
+#include <signal.h>       // sigaction
+#include <stdio.h>        // fprintf, perror
+#include <stdlib.h>       // exit, atoi
+#include <string.h>       // memset
+#include <sys/mman.h>     // shm_open
+#include <sys/resource.h> // getrusage
+#include <time.h>         // time, clock_gettime
+#include <unistd.h>       // fork, alarm, execl, write
+#include <wait.h>         // wait
+
+#include "affinity.h"
+#include "analytics.h"
+#include "flowfield.h"
+#include "game.h"
+#include "ipc.h"
+#include "kinetic.h"
 #include "map.h"
+#include "notify.h"
+#include "recorder.h"
+#include "rewind.h"
+#include "scenario.h"
+#include "shm.h"
 #include "simulator.h"
+#include "snapshot.h"
+#include "trace.h"
 
 extern char team_symbols[N_TEAMS];
 
 int flag_SIGALRM;
-int fd_pipe_leader[N_TEAMS][2]; // Used to communicate with leader processes
-int fd_shm_map;                 // Shared memory with the map
-mqd_t queue;                    // message queue with spaceships
-map_t* pmap = NULL;             // pointer to the map
-sem_t* sem_w = NULL;            // semaphore for writers
-sem_t* sem_ready = NULL;        // semapore for monitor process
-sem_t* sem_r = NULL;            // semaphore for readers
-sem_t* sem_mutex = NULL;        // semaphore for mutex sem_r
-sem_t* sem_count_r = NULL;      // semaphore for counting readers
+int fd_pipe_leader[N_TEAMS][2];  // Used to communicate with leader processes
+ipc_names_t ipc_names;           // Names of the resources of this instance
+shm_region_t shm_map;            // Shared memory with the map
+int shm_flags = 0;               // SHM_* allocation options of the map
+shm_region_t shm_rewind;         // Shared memory with the last turns
+rewind_t* prewind = NULL;        // pointer to the last turns
+bool pipelined = false;          // Agents decide while moves are resolved
+shm_region_t shm_snapshot;       // Shared memory with the last turn
+snapshot_t* psnapshot = NULL;    // pointer to the last turn, if pipelined
+int sensor_range = SENSOR_RANGE; // Squares seen around each spaceship
+bool splash = false;             // Spaceships may fire SPLASH
+blasts_t blasts;                 // SPLASH launched in the current turn
+bool continuous = false;         // Spaceships move with THRUST
+mqd_t queues[N_TEAMS];           // message queue of each team
+map_t* pmap = NULL;              // pointer to the map
+sem_t* sem_w = NULL;             // semaphore for writers
+sem_t* sem_ready = NULL;         // semapore for monitor process
+bool wait_monitor = false;       // The battle starts once a monitor is ready
+sem_t* sem_r = NULL;             // semaphore for readers
+sem_t* sem_mutex = NULL;         // semaphore for mutex sem_r
+sem_t* sem_count_r = NULL;       // semaphore for counting readers
+recorder_t recorder;             // recording of the match
+bool recording = false;          // the match is being recorded
+analytics_t analytics;           // metrics of the match
+char* analytics_path = NULL;     // file for the metrics, NULL if disabled
+affinity_plan_t placement;       // CPUs of every process
+bool pinning = false;            // the processes are pinned to placement
+scenario_t scenario;             // terrain and formations of the match
+bool has_scenario = false;       // scenario loaded, else an open map
 
 static status init_shared_resources();
 static void init_map();
@@ -32,6 +69,22 @@ static void handler_SIGALRM(int signal);
 static void handler_SIGINT(int signal);
 static void free_resources();
 static void process_move(move_t move);
+static void resolve_blasts();
+static void drain_queues(int turn);
+static void admit_move(move_t move, int team, int turn);
+static void end_admission(int turn);
+static int due_turn(int turn);
+static void start_turn(command_t* cmd);
+
+// Deficit round robin between the team queues. A move is taken out of its
+// queue before knowing its cost, so it waits in head until the team has
+// enough deficit.
+int deficit[N_TEAMS];
+move_t head[N_TEAMS];
+bool has_head[N_TEAMS];
+int first_team = 0; // Team served first in the next round
+// Moves processed of each spaceship, for the current and the previous turn
+int budget_used[2][N_TEAMS][N_SPACESHIPS];
 
 int main(int argc, char* argv[])
 {
@@ -40,9 +93,102 @@ int main(int argc, char* argv[])
     char id_leader[MAX_CHAR_ID];
     int sval;
     command_t cmd; // Commands sent to leaders
-    move_t move;   // Moves sent by spaceships
-    int teams_alive;
     int winner;
+    int turn;
+    int opt;
+    uint64_t span;
+    char* record_path = NULL;
+    int keyframe_interval = RECORD_KEYFRAME_INTERVAL;
+    char* instance = NULL;
+
+    while ((opt = getopt(argc, argv, "i:m:r:k:a:S:pwcWAHPN")) != -1) {
+        switch (opt) {
+            case 'i':
+                instance = optarg;
+                break;
+            case 'm':
+                if (!scenario_load(&scenario, optarg)) {
+                    exit(EXIT_FAILURE);
+                }
+                has_scenario = true;
+                break;
+            case 'r':
+                record_path = optarg;
+                break;
+            case 'k':
+                keyframe_interval = atoi(optarg);
+                if (keyframe_interval <= 0) {
+                    fprintf(stderr, "[SIMULATOR] Invalid keyframe interval\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'a':
+                analytics_path = optarg;
+                break;
+            case 'S':
+                sensor_range = atoi(optarg);
+                if (sensor_range < 0) {
+                    fprintf(stderr, "[SIMULATOR] Invalid sensor range\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'p':
+                pipelined = true;
+                break;
+            case 'w':
+                splash = true;
+                break;
+            case 'c':
+                continuous = true;
+                break;
+            case 'W':
+                wait_monitor = true;
+                break;
+            case 'A':
+                pinning = true;
+                break;
+            case 'H':
+                shm_flags |= SHM_HUGE;
+                break;
+            case 'P':
+                shm_flags |= SHM_PREFAULT;
+                break;
+            case 'N':
+                shm_flags |= SHM_INTERLEAVE;
+                break;
+            default:
+                fprintf(stderr,
+                        "Usage: %s [-i instance] [-m scenario] "
+                        "[-r recording] [-k keyframe_interval] [-a analytics] "
+                        "[-S sensor_range] [-p] [-w] [-c] [-W] [-A] [-H] "
+                        "[-P] [-N]\n",
+                        argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!ipc_names_init(&ipc_names, instance)) {
+        fprintf(stderr, "[SIMULATOR] Invalid instance id...\n");
+        exit(EXIT_FAILURE);
+    }
+    trace_init("simulator");
+    if (!ipc_reclaim(&ipc_names)) {
+        fprintf(stderr,
+                "[SIMULATOR] The instance '%s' is already running...\n",
+                ipc_names.instance);
+        exit(EXIT_FAILURE);
+    }
+
+    // Pinned before the map is created, so its pages come from our node
+    if (pinning) {
+        if (!affinity_plan(&placement) ||
+            !affinity_pin_cpu(placement.simulator_cpu)) {
+            perror("[SIMULATOR] Error pinning the processes...\n");
+            pinning = false;
+        } else {
+            affinity_report(&placement);
+        }
+    }
 
     // init resources
     fprintf(stdout, "[SIMULATOR] Initializing shared resources...\n");
@@ -55,6 +201,28 @@ int main(int argc, char* argv[])
     printf("[SIMULATOR] Initializing the map...\n");
     init_map();
 
+    if (record_path) {
+        fprintf(
+          stdout, "[SIMULATOR] Recording the match in %s...\n", record_path);
+        if (!recorder_open(&recorder, record_path, keyframe_interval)) {
+            free_resources();
+            exit(EXIT_FAILURE);
+        }
+        recording = true;
+    }
+    if (analytics_path) {
+        analytics_init(&analytics);
+    }
+    turn = pmap->turn = 0;
+    pmap->turn_hash = pmap->hash;
+    if (recording && !recorder_write_turn(&recorder, pmap, turn)) {
+        fprintf(stderr, "[SIMULATOR] Error recording the turn %d\n", turn);
+    }
+    rewind_push(prewind, pmap);
+    if (pipelined) {
+        snapshot_publish(psnapshot, pmap);
+    }
+
     // leader spawns
     for (i = 0; i < N_TEAMS; i++) {
         pid = fork();
@@ -67,72 +235,105 @@ int main(int argc, char* argv[])
             close(fd_pipe_leader[i][WRITE]);
             dup2(fd_pipe_leader[i][READ], STDIN_FILENO);
             close(fd_pipe_leader[i][READ]);
+            // The spaceships of the leader inherit its CPUs
+            if (pinning && !affinity_pin_set(&placement.teams[i])) {
+                perror("[SIMULATOR] Error pinning the leader...\n");
+            }
             sprintf(id_leader, "%d", i);
-            execl("./leader", "leader", id_leader, NULL);
+            execl("./leader", "leader", id_leader, ipc_names.instance, NULL);
             perror("[SIMULATOR]: execl");
             exit(EXIT_FAILURE);
         }
     }
 
-    // Simulation start
-    if (sem_getvalue(sem_ready, &sval) == 0) {
-        fprintf(stdout, "[SIMULATOR] Waiting for the monitor process...\n");
+    // Simulation start. Monitors attach and detach at any time, from the
+    // last turn kept for rewind, so only -W waits for one.
+    if (wait_monitor) {
+        if (sem_getvalue(sem_ready, &sval) == 0 && sval == 0) {
+            fprintf(stdout,
+                    "[SIMULATOR] Waiting for the monitor process...\n");
+        }
+        sem_wait(sem_ready);
     }
-    sem_wait(sem_ready);
     fprintf(stdout, "[SIMULATOR] Start of battle...\n");
+    if (pipelined) {
+        start_turn(&cmd);
+    }
     while (1) {
         fprintf(stdout, "[SIMULATOR] New turn...\n");
-        alarm(TURN_DURATION);
-        // Send the command to leaders processes
-        cmd.type = TURN;
-        for (i = 0; i < N_TEAMS; i++) {
-            write(fd_pipe_leader[i][WRITE], &cmd, sizeof(command_t));
+        if (!pipelined) {
+            start_turn(&cmd);
+        }
+        if (analytics_path) {
+            analytics_begin_turn(&analytics);
         }
         flag_SIGALRM = 0;
         while (!flag_SIGALRM) {
-            // Read messages sent by the spaceships from the queue
-            fprintf(stdout, "[SIMULATOR] Listening to the message queue...\n");
-            if (mq_receive(queue, (char*)&move, sizeof(move), NULL) == -1) {
-                if (errno == EINTR) {
-                    // We should restart the loop to check flag_SIGALRM
-                    continue;
-                } else {
-                    perror("[SIMULATOR] mq_receive");
-                }
-            }
-            fprintf(stdout, "[SIMULATOR] Message received in the queue...\n");
-
-            // Process the move sent by the spaceship
-            sem_wait(sem_r);
-            sem_wait(sem_w);
-
-            process_move(move);
-
-            sem_post(sem_w);
-            sem_post(sem_r);
-
-            usleep(100000);
+            // Read messages sent by the spaceships from the queues
+            fprintf(stdout,
+                    "[SIMULATOR] Listening to the message queues...\n");
+            drain_queues(turn);
         }
+        end_admission(turn);
         // Upload the map
+        span = trace_begin();
         sem_wait(sem_r);
         sem_wait(sem_w);
 
+        resolve_blasts();
+        if (continuous) {
+            fprintf(stdout,
+                    "[SIMULATOR] %d spaceships changed square...\n",
+                    kinetic_advance(pmap));
+        }
         map_restore(pmap);
+        flowfield_update(pmap);
+        if (splash) {
+            map_update_occupancy(pmap);
+        }
+        pmap->turn = ++turn;
+        pmap->turn_hash = pmap->hash;
 
         sem_post(sem_w);
         sem_post(sem_r);
+        notify_commit(pmap);
+        trace_end("commit turn", span, turn);
+        fprintf(stdout,
+                "[SIMULATOR] Turn %d, state hash %016llx...\n",
+                turn,
+                (unsigned long long)pmap->turn_hash);
+
+        // The agents start deciding the next turn on this one while we
+        // publish it and resolve the moves they decided on the previous one
+        if (pipelined && game_get_winner(pmap) < 0) {
+            snapshot_publish(psnapshot, pmap);
+            start_turn(&cmd);
+        }
 
-        // Check if there is a winner
-        for (i = 0, teams_alive = 0; i < N_TEAMS; i++) {
-            if (map_get_num_spaceships(pmap, i)) {
-                teams_alive++;
-                winner = i;
-            }
+        // The map is only read here so the recording does not need the lock
+        if (recording && !recorder_write_turn(&recorder, pmap, turn)) {
+            fprintf(stderr, "[SIMULATOR] Error recording the turn %d\n", turn);
+        }
+        rewind_push(prewind, pmap);
+        // Wakes the readers of the last turns, as the observer, again
+        notify_commit(pmap);
+        if (analytics_path && !analytics_end_turn(&analytics, pmap, turn)) {
+            fprintf(stderr,
+                    "[SIMULATOR] Error saving the metrics of turn %d\n",
+                    turn);
         }
 
-        if (teams_alive == 1) {
-            fprintf(
-              stdout, "[SIMULATOR] Winner: %c...\n", team_symbols[winner]);
+        // Check if there is a winner. SPLASH may destroy the last spaceships
+        // of every team in the same turn, which is a draw.
+        winner = game_get_winner(pmap);
+        if (winner >= 0) {
+            if (winner < N_TEAMS) {
+                fprintf(stdout,
+                        "[SIMULATOR] Winner: %c...\n",
+                        team_symbols[winner]);
+            } else {
+                fprintf(stdout, "[SIMULATOR] Draw...\n");
+            }
             cmd.type = END;
             for (i = 0; i < N_TEAMS; i++) {
                 write(fd_pipe_leader[i][WRITE], &cmd, sizeof(command_t));
@@ -153,25 +354,43 @@ static status init_shared_resources()
     struct sigaction act;
     struct mq_attr attributes;
 
+    for (i = 0; i < N_TEAMS; i++) {
+        queues[i] = (mqd_t)-1;
+    }
+
     // Shared memory
     fprintf(stdout, "[SIMULATOR] Managing shared memory...\n");
-    fd_shm_map =
-      shm_open(SHM_MAP_NAME, O_CREAT | O_EXCL | O_RDWR, S_IWUSR | S_IRUSR);
-    if (fd_shm_map == -1) {
+    if (!shm_region_create(
+          &shm_map, ipc_names.shm_map, sizeof(map_t), shm_flags)) {
         perror("[SIMULATOR] Error creating the shared memory...\n");
         return ERROR;
     }
-
-    if (ftruncate(fd_shm_map, sizeof(map_t)) == -1) {
-        perror("[SIMULATOR] Error sizing the shared memory...\n");
+    pmap = (map_t*)shm_map.addr;
+    pmap->owner = getpid(); // Tells a later start whether we are alive
+    pmap->monitor_cpu = pinning ? placement.monitor_cpu : -1;
+    shm_region_report(&shm_map, "SIMULATOR");
+
+    // Last turns for the monitor to go back
+    if (!shm_region_create(
+          &shm_rewind, ipc_names.shm_rewind, sizeof(rewind_t), 0)) {
+        perror("[SIMULATOR] Error creating the rewind buffer...\n");
         return ERROR;
     }
-
-    pmap = (map_t*)mmap(
-      NULL, sizeof(map_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd_shm_map, 0);
-    if (pmap == MAP_FAILED) {
-        perror("[SIMULATOR] Error mapping the shared memory...\n");
-        return ERROR;
+    prewind = (rewind_t*)shm_rewind.addr;
+    rewind_init(prewind);
+
+    // Committed turns for the agents of a pipelined match
+    if (pipelined) {
+        if (!shm_region_create(&shm_snapshot,
+                               ipc_names.shm_snapshot,
+                               sizeof(snapshot_t),
+                               0)) {
+            perror("[SIMULATOR] Error creating the snapshot...\n");
+            return ERROR;
+        }
+        psnapshot = (snapshot_t*)shm_snapshot.addr;
+        snapshot_init(psnapshot);
+        pmap->pipelined = true;
     }
 
     // Pipes
@@ -184,52 +403,56 @@ static status init_shared_resources()
         }
     }
 
-    // Queue
+    // Queues, one per team so a team cannot fill the queue of the others
     attributes.mq_flags = 0;
-    attributes.mq_maxmsg = 10;
+    attributes.mq_maxmsg = MQ_TEAM_DEPTH;
     attributes.mq_curmsgs = 0;
     attributes.mq_msgsize = sizeof(move_t);
 
-    fprintf(stdout, "[SIMULADOR] Managing message queue...\n");
-    queue = mq_open(MQ_ACTION_NAME,
-                    O_CREAT | O_EXCL | O_RDONLY,
-                    S_IWUSR | S_IRUSR,
-                    &attributes);
-    if (queue == (mqd_t)-1) {
-        perror("[SIMULATOR] Error creating the queue...\n");
-        return ERROR;
+    fprintf(stdout, "[SIMULADOR] Managing message queues...\n");
+    for (i = 0; i < N_TEAMS; i++) {
+        queues[i] = mq_open(ipc_names.mq_actions[i],
+                            O_CREAT | O_EXCL | O_RDONLY | O_NONBLOCK,
+                            S_IWUSR | S_IRUSR,
+                            &attributes);
+        if (queues[i] == (mqd_t)-1) {
+            perror("[SIMULATOR] Error creating the queues...\n");
+            return ERROR;
+        }
     }
 
     // Semaphores
     fprintf(stdout, "[SIMULADOR] Managing semaphores...\n");
-    sem_ready =
-      sem_open(SEM_READY_NAME, O_CREAT | O_EXCL, S_IRUSR | S_IWUSR, 0);
+    sem_ready = sem_open(
+      ipc_names.sem_ready, O_CREAT | O_EXCL, S_IRUSR | S_IWUSR, 0);
     if (sem_ready == SEM_FAILED) {
         perror("[SIMULATOR] Error creating the semaphore sem_ready...\n");
         return ERROR;
     }
 
-    sem_w = sem_open(SEM_W_NAME, O_CREAT | O_EXCL, S_IRUSR | S_IWUSR, 1);
+    sem_w =
+      sem_open(ipc_names.sem_w, O_CREAT | O_EXCL, S_IRUSR | S_IWUSR, 1);
     if (sem_w == SEM_FAILED) {
         perror("[SIMULATOR] Error creating the semaphore sem_w...\n");
         return ERROR;
     }
 
-    sem_r = sem_open(SEM_R_NAME, O_CREAT | O_EXCL, S_IRUSR | S_IWUSR, 1);
+    sem_r =
+      sem_open(ipc_names.sem_r, O_CREAT | O_EXCL, S_IRUSR | S_IWUSR, 1);
     if (sem_r == SEM_FAILED) {
         perror("[SIMULATOR] Error creating the semaphore sem_r...\n");
         return ERROR;
     }
 
-    sem_mutex =
-      sem_open(SEM_MUTEX_R_NAME, O_CREAT | O_EXCL, S_IRUSR | S_IWUSR, 1);
+    sem_mutex = sem_open(
+      ipc_names.sem_mutex, O_CREAT | O_EXCL, S_IRUSR | S_IWUSR, 1);
     if (sem_mutex == SEM_FAILED) {
         perror("[SIMULATOR] Error creating the semaphore sem_mutex...\n");
         return ERROR;
     }
 
-    sem_count_r =
-      sem_open(SEM_COUNT_R_NAME, O_CREAT | O_EXCL, S_IRUSR | S_IWUSR, 0);
+    sem_count_r = sem_open(
+      ipc_names.sem_count_r, O_CREAT | O_EXCL, S_IRUSR | S_IWUSR, 0);
     if (sem_count_r == SEM_FAILED) {
         perror("[SIMULATOR] Error creating the semaphore sem_count_r...\n");
         return ERROR;
@@ -279,6 +502,7 @@ static void handler_SIGINT(int signal)
 static void free_resources()
 {
     int i;
+    struct rusage usage;
 
     kill(0, SIGTERM);
 
@@ -287,150 +511,380 @@ static void free_resources()
         close(fd_pipe_leader[i][WRITE]);
         close(fd_pipe_leader[i][READ]);
     }
+    // The leaders and their spaceships have written their traces
+    trace_flush();
+    trace_merge();
 
     // Remove every resource allocated
-    mq_close(queue);
-    mq_unlink(MQ_ACTION_NAME);
+    for (i = 0; i < N_TEAMS; i++) {
+        if (queues[i] != (mqd_t)-1) {
+            mq_close(queues[i]);
+        }
+    }
+    if (prewind) {
+        fprintf(stdout,
+                "[SIMULATOR] Rewind buffer: %ld pages copied, %ld shared...\n",
+                prewind->pages_copied,
+                prewind->pages_shared);
+        prewind = NULL;
+    }
+    ipc_unlink(&ipc_names);
+
+    shm_region_detach(&shm_rewind);
+    shm_region_detach(&shm_snapshot);
+    shm_region_destroy(&shm_map, ipc_names.shm_map);
 
-    sem_unlink(SEM_COUNT_R_NAME);
-    sem_unlink(SEM_MUTEX_R_NAME);
-    sem_unlink(SEM_W_NAME);
-    sem_unlink(SEM_R_NAME);
-    sem_unlink(SEM_READY_NAME);
+    if (recording) {
+        recorder_close(&recorder);
+        recording = false;
+    }
 
-    munmap(pmap, sizeof(map_t));
-    shm_unlink(SHM_MAP_NAME);
+    // The metrics stay in memory during the match and are written here
+    if (analytics_path) {
+        if (analytics_write(&analytics, analytics_path)) {
+            fprintf(stdout,
+                    "[SIMULATOR] Metrics of the match saved in %s...\n",
+                    analytics_path);
+        }
+        analytics_free(&analytics);
+        analytics_path = NULL;
+    }
+
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(stdout,
+            "[SIMULATOR] %ld minor and %ld major page faults in the run...\n",
+            usage.ru_minflt,
+            usage.ru_majflt);
 }
 
 static void init_map()
 {
-    int i, j;
-    spaceship_t spaceship;
-    int posx, posy;
+    int i;
+    unsigned int seed = time(NULL);
+    int height = has_scenario ? scenario.height : MAP_MAX_Y;
+    int width = has_scenario ? scenario.width : MAP_MAX_X;
+    bool fixed;
+
+    if (has_scenario) {
+        fprintf(stdout,
+                "[SIMULATOR] Scenario of %dx%d squares...\n",
+                scenario.height,
+                scenario.width);
+        for (i = 0; i < N_TEAMS; i++) {
+            fprintf(stdout,
+                    "[SIMULATOR] Team %c in %s formation...\n",
+                    team_symbols[i],
+                    scenario_formation_name(scenario.formation[i]));
+        }
+    }
+    fixed = map_set_area(height, width);
+    fprintf(stdout,
+            "[SIMULATOR] %s map kernels for %dx%d squares...\n",
+            fixed ? "Fixed" : "Generic",
+            height,
+            width);
+    if (continuous) {
+        fprintf(stdout, "[SIMULATOR] Continuous movement...\n");
+        pmap->continuous = true;
+    }
+    map_set_sensor_range(pmap, sensor_range);
+    game_init_map(pmap, has_scenario ? &scenario : NULL, &seed);
+    flowfield_update(pmap);
+    if (splash) {
+        fprintf(stdout,
+                "[SIMULATOR] Splash weapons of radius %d...\n",
+                SPLASH_RADIUS);
+        pmap->splash = true;
+        map_update_occupancy(pmap);
+    }
+}
+
+static void process_move(move_t move)
+{
+    spaceship_t attacked_spaceship;
+    command_t cmd;
+    char symbol;
+    outcome_t outcome;
+    struct timespec start, end;
+
+    if ((move.type == ATTACK || move.type == SPLASH) && move.team >= 0 &&
+        move.team < N_TEAMS &&
+        move.id_spaceship >= 0 && move.id_spaceship < N_SPACESHIPS &&
+        map_get_spaceship(pmap, move.team, move.id_spaceship).alive) {
+        map_send_missil(
+          pmap, move.originY, move.originX, move.objetiveY, move.objetiveX);
+    }
+
+    symbol = (move.team >= 0 && move.team < N_TEAMS) ? team_symbols[move.team]
+                                                     : '?';
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    outcome = game_process_move(pmap, move, &attacked_spaceship);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (analytics_path) {
+        analytics_add_move(&analytics,
+                           move,
+                           outcome,
+                           &attacked_spaceship,
+                           (end.tv_sec - start.tv_sec) * 1000000L +
+                             (end.tv_nsec - start.tv_nsec) / 1000);
+    }
+
+    switch (outcome) {
+        case OUTCOME_INVALID:
+        case OUTCOME_BLOCKED:
+            break;
+        case OUTCOME_MOVED:
+            fprintf(stdout,
+                    "[SIMULATOR] ACTION MOVE [%c%d] %d,%d -> %d,%d...\n",
+                    symbol,
+                    move.id_spaceship,
+                    move.originX,
+                    move.originY,
+                    move.objetiveX,
+                    move.objetiveY);
+            break;
+        case OUTCOME_MISSED:
+            printf("[SIMULATOR] ACTION ATTACK [%c%d] %d,%d -> %d,%d: "
+                   "FAILED: Objective square empty...\n",
+                   symbol,
+                   move.id_spaceship,
+                   move.originX,
+                   move.originY,
+                   move.objetiveX,
+                   move.objetiveY);
+            break;
+        case OUTCOME_DESTROYED:
+            printf("[SIMULATOR] ACTION ATTACK [%c%d] %d,%d -> %d,%d: target "
+                   "destroyed...\n",
+                   symbol,
+                   move.id_spaceship,
+                   move.originX,
+                   move.originY,
+                   move.objetiveX,
+                   move.objetiveY);
+            cmd.type = DESTROY;
+            cmd.id_spaceship = attacked_spaceship.id;
+            cmd.flow = trace_flow_start();
+            write(fd_pipe_leader[attacked_spaceship.team][WRITE],
+                  &cmd,
+                  sizeof(command_t));
+            break;
+        case OUTCOME_DAMAGED:
+            printf("[SIMULATOR] ACTION ATTACK [%c%d] %d,%d -> %d,%d: target "
+                   "damaged with %d remaining health...\n",
+                   symbol,
+                   move.id_spaceship,
+                   move.originX,
+                   move.originY,
+                   move.objetiveX,
+                   move.objetiveY,
+                   attacked_spaceship.health);
+            break;
+        case OUTCOME_THRUST:
+            fprintf(stdout,
+                    "[SIMULATOR] ACTION THRUST [%c%d] %.2f,%.2f...\n",
+                    symbol,
+                    move.id_spaceship,
+                    move.thrustx,
+                    move.thrusty);
+            break;
+        case OUTCOME_LAUNCHED:
+            printf("[SIMULATOR] ACTION SPLASH [%c%d] %d,%d -> %d,%d...\n",
+                   symbol,
+                   move.id_spaceship,
+                   move.originX,
+                   move.originY,
+                   move.objetiveX,
+                   move.objetiveY);
+            game_add_blast(&blasts, move);
+            break;
+    }
+}
 
-    srand(time(NULL));
+/* Applies the SPLASH of the turn at once. Called with the map locked. */
+static void resolve_blasts()
+{
+    int i, n_victims;
+    spaceship_t victims[N_TEAMS * N_SPACESHIPS];
+    blasts_t fired = blasts; // game_resolve_blasts empties them
+    command_t cmd;
 
-    // Clean the map
-    for (i = 0; i < MAP_MAX_X; i++) {
-        for (j = 0; j < MAP_MAX_Y; j++) {
-            map_clean_square(pmap, j, i);
+    n_victims = game_resolve_blasts(pmap, &blasts, victims);
+    if (analytics_path) {
+        analytics_add_blasts(&analytics, &fired, victims, n_victims);
+    }
+    for (i = 0; i < n_victims; i++) {
+        printf("[SIMULATOR] SPLASH hit [%c%d] %d,%d: %d remaining health...\n",
+               team_symbols[victims[i].team],
+               victims[i].id,
+               victims[i].posx,
+               victims[i].posy,
+               victims[i].health);
+        if (!victims[i].alive) {
+            cmd.type = DESTROY;
+            cmd.id_spaceship = victims[i].id;
+            cmd.flow = trace_flow_start();
+            write(fd_pipe_leader[victims[i].team][WRITE],
+                  &cmd,
+                  sizeof(command_t));
         }
     }
+}
 
-    // Set up the spaceships in the map
+/* Waits for moves and processes them until the queues are empty or the turn
+ * ends. Each round a team earns DRR_QUANTUM and spends it on the moves at the
+ * head of its queue, so a busy team cannot starve the others. */
+static void drain_queues(int turn)
+{
+    int i, k, cost, served;
+    struct pollfd fds[N_TEAMS];
+
+    // Linux message queues are file descriptors. A team whose next move is
+    // for a later turn is not polled, its queue waits for that turn.
     for (i = 0; i < N_TEAMS; i++) {
-        map_set_num_spaceships(pmap, i, N_SPACESHIPS);
-        for (j = 0; j < N_SPACESHIPS; j++) {
-            spaceship.health = MAX_LIFE_SPACESHIPS;
-            spaceship.team = i;
-            spaceship.id = j;
-            spaceship.alive = true;
-            // Search for an empty square
-            while (1) {
-                posx = rand() % (MAP_MAX_X);
-                posy = rand() % (MAP_MAX_Y);
-                if (map_is_square_empty(pmap, posx, posy)) {
+        fds[i].fd = (has_head[i] && head[i].turn > due_turn(turn))
+                      ? -1
+                      : queues[i];
+        fds[i].events = POLLIN;
+    }
+    if (poll(fds, N_TEAMS, -1) == -1) {
+        if (errno != EINTR) {
+            perror("[SIMULATOR] poll");
+        }
+        return;
+    }
+
+    do {
+        served = 0;
+        for (k = 0; k < N_TEAMS && !flag_SIGALRM; k++) {
+            i = (first_team + k) % N_TEAMS;
+            deficit[i] += DRR_QUANTUM;
+            while (!flag_SIGALRM) {
+                if (!has_head[i]) {
+                    if (mq_receive(queues[i],
+                                   (char*)&head[i],
+                                   sizeof(move_t),
+                                   NULL) == -1) {
+                        // An idle team does not save deficit
+                        deficit[i] = 0;
+                        break;
+                    }
+                    has_head[i] = true;
+                }
+                if (head[i].turn > due_turn(turn)) {
+                    // Nor does a team whose next move waits for a later turn
+                    deficit[i] = 0;
                     break;
                 }
+                cost = (head[i].type == ATTACK)   ? DRR_COST_ATTACK
+                       : (head[i].type == SPLASH) ? DRR_COST_SPLASH
+                                                  : DRR_COST_MOVE;
+                if (cost > deficit[i]) {
+                    break;
+                }
+                deficit[i] -= cost;
+                has_head[i] = false;
+                admit_move(head[i], i, turn);
+                served++;
             }
-            spaceship.posx = posx;
-            spaceship.posy = posy;
-            map_set_spaceship(pmap, spaceship);
         }
+        first_team = (first_team + 1) % N_TEAMS;
+    } while (served && !flag_SIGALRM);
+}
+
+/* Processes a move of the queue of team if the spaceship has budget left.
+ * Moves of the previous turn that were deferred are still valid. */
+static void admit_move(move_t move, int team, int turn)
+{
+    admission_t* admission = &pmap->admission[team];
+    int* used;
+    int due = due_turn(turn);
+    uint64_t span;
+
+    // Whatever happens to it, the move is out of the queue
+    if (move.seq) {
+        __atomic_store_n(&pmap->acked[team], move.seq, __ATOMIC_RELEASE);
+    }
+    admission->coalesced += move.coalesced;
+    if (move.team != team || move.id_spaceship < 0 ||
+        move.id_spaceship >= N_SPACESHIPS ||
+        (move.turn != due && move.turn != due - 1)) {
+        admission->dropped++;
+        return;
+    }
+    used = &budget_used[move.turn & 1][team][move.id_spaceship];
+    if (*used >= N_ACTIONS_LEADER) {
+        admission->dropped++;
+        return;
     }
+    (*used)++;
+    admission->accepted++;
+
+    fprintf(stdout, "[SIMULATOR] Message received in the queue...\n");
+
+    // Process the move sent by the spaceship
+    span = trace_begin();
+    trace_flow_end(move.flow);
+    sem_wait(sem_r);
+    sem_wait(sem_w);
+
+    process_move(move);
+
+    sem_post(sem_w);
+    sem_post(sem_r);
+    notify_commit(pmap);
+    trace_end(
+      "process_move", span, move.team * N_SPACESHIPS + move.id_spaceship);
+
+    usleep(100000);
 }
 
-static void process_move(move_t move)
+/* Turn of the map the moves resolved in turn were decided on. Pipelined,
+ * the agents decide on the snapshot of the previous turn. */
+static int due_turn(int turn)
 {
-    square_t square;
-    spaceship_t attacked_spaceship, spaceship;
-    command_t cmd;
+    return pipelined ? turn - 1 : turn;
+}
 
-    spaceship = map_get_spaceship(pmap, move.team, move.id_spaceship);
-    if (!spaceship.alive) {
-        // The spaceship die before it move
-        return;
+/* Starts the alarm of a turn and sends it to the leaders. */
+static void start_turn(command_t* cmd)
+{
+    int i;
+    uint64_t span = trace_begin();
+
+    alarm(TURN_DURATION);
+    memset(budget_used[due_turn(pmap->turn) & 1], 0, sizeof(budget_used[0]));
+    cmd->type = TURN;
+    for (i = 0; i < N_TEAMS; i++) {
+        cmd->flow = trace_flow_start();
+        write(fd_pipe_leader[i][WRITE], cmd, sizeof(command_t));
     }
+    trace_end("send TURN", span, pmap->turn);
+}
 
-    /*Mover*/
-    switch (move.type) {
-        case MOVE:
-            if (map_is_square_empty(pmap, move.objetiveY, move.objetiveX)) {
-                fprintf(stdout,
-                        "[SIMULATOR] ACTION MOVE [%c%d] %d,%d -> %d,%d...\n",
-                        team_symbols[spaceship.team],
-                        spaceship.id,
-                        move.originX,
-                        move.originY,
-                        move.objetiveX,
-                        move.objetiveY);
-                map_clean_square(pmap, spaceship.posy, spaceship.posx);
-                spaceship.posx = move.objetiveX;
-                spaceship.posy = move.objetiveY;
-                map_set_spaceship(pmap, spaceship);
-            }
-            break;
-        case ATTACK:
-            map_send_missil(
-              pmap, move.originY, move.originX, move.objetiveY, move.objetiveX);
-            square = map_get_square(pmap, move.objetiveY, move.objetiveX);
-            attacked_spaceship =
-              map_get_spaceship(pmap, square.team, square.id_spaceship);
-            if (map_is_square_empty(pmap, move.objetiveY, move.objetiveX) ||
-                !attacked_spaceship.alive) {
-                printf("[SIMULATOR] ACTION ATTACK [%c%d] %d,%d -> %d,%d: "
-                       "FAILED: Objective square empty...\n",
-                       team_symbols[spaceship.team],
-                       spaceship.id,
-                       move.originX,
-                       move.originY,
-                       move.objetiveX,
-                       move.objetiveY);
-                map_set_symbol(
-                  pmap, move.objetiveY, move.objetiveX, SYMB_WATER);
-            } else {
-                attacked_spaceship.health =
-                  attacked_spaceship.health - ATACK_DAMAGE;
-                if (attacked_spaceship.health <= 0) {
-                    printf(
-                      "[SIMULATOR] ACTION ATTACK [%c%d] %d,%d -> %d,%d: target "
-                      "destroyed...\n",
-                      team_symbols[spaceship.team],
-                      spaceship.id,
-                      move.originX,
-                      move.originY,
-                      move.objetiveX,
-                      move.objetiveY);
-                    map_set_symbol(
-                      pmap, move.objetiveY, move.objetiveY, SYMB_DESTROYED);
-                    cmd.type = DESTROY;
-                    cmd.id_spaceship = attacked_spaceship.id;
-                    write(fd_pipe_leader[attacked_spaceship.team][WRITE],
-                          &cmd,
-                          sizeof(command_t));
-                    map_set_num_spaceships(
-                      pmap,
-                      attacked_spaceship.team,
-                      map_get_num_spaceships(pmap, attacked_spaceship.team) -
-                        1);
-                    attacked_spaceship.alive = false;
-                    attacked_spaceship.health = 0;
-                } else {
-                    printf(
-                      "[SIMULATOR] ACTION ATTACK [%c%d] %d,%d -> %d,%d: target "
-                      "damaged with %d remaining health...\n",
-                      team_symbols[spaceship.team],
-                      spaceship.id,
-                      move.originX,
-                      move.originY,
-                      move.objetiveX,
-                      move.objetiveY,
-                      attacked_spaceship.health);
-                    map_set_symbol(
-                      pmap, move.objetiveY, move.objetiveX, SYMB_DAMAGED);
-                }
-                map_set_spaceship(pmap, attacked_spaceship);
-            }
-            break;
+/* Counts the moves that did not fit in the turn and reports the admission. */
+static void end_admission(int turn)
+{
+    int i;
+    struct mq_attr attributes;
+    admission_t* admission;
+
+    for (i = 0; i < N_TEAMS; i++) {
+        admission = &pmap->admission[i];
+        if (mq_getattr(queues[i], &attributes) == 0) {
+            admission->deferred += attributes.mq_curmsgs;
+        }
+        if (has_head[i]) {
+            admission->deferred++;
+        }
+        fprintf(stdout,
+                "[SIMULATOR] Team %c after turn %d: %d accepted, %d dropped, "
+                "%d deferred, %d coalesced...\n",
+                team_symbols[i],
+                turn + 1,
+                admission->accepted,
+                admission->dropped,
+                admission->deferred,
+                admission->coalesced);
     }
 }
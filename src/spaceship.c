@@ -2,45 +2,74 @@
 #include <mqueue.h>    // mq_open
 #include <semaphore.h> // sem_open
 #include <signal.h>    // sigaction
+#include <stdbool.h>   // bool
+#include <stdint.h>    // uint64_t
+#include <errno.h>     // errno
 #include <stdio.h>     // fprintf
 #include <stdlib.h>    // exit
 #include <sys/mman.h>  // shm_open
 #include <time.h>      // time
 #include <unistd.h>    // STDIN_FILENO
 
+#include "ai.h"
+#include "ipc.h"
 #include "map.h"
+#include "shm.h"
 #include "simulator.h"
+#include "snapshot.h"
+#include "trace.h"
 
-mqd_t queue;               // message queue with simulator
-int fd_shm_map;            // Shared memory with the map
+ipc_names_t ipc_names;     // Names of the resources of the instance
+mqd_t queue;               // message queue of the team with simulator
+shm_region_t shm_map;      // Shared memory with the map
 map_t* pmap = NULL;        // pointer to the map
+shm_region_t shm_snapshot; // Shared memory with the last turn, if pipelined
+snapshot_t* psnapshot = NULL;
 sem_t* sem_w = NULL;       // semaphore for writers
 sem_t* sem_r = NULL;       // semaphore for readers
 sem_t* sem_mutex = NULL;   // semaphore for mutex sem_r
 sem_t* sem_count_r = NULL; // semaphore for counting readers
 
+static map_t committed; // Copy of the last turn to decide on, if pipelined
+
+extern char team_symbols[N_TEAMS];
+
 static status init_shared_resources(int team, int id_spaceship);
 static void free_resources();
 static void handler_SIGTERM();
-static spaceship_t locate_enemy_spaceship(map_t* pmap, spaceship_t spaceship);
-static unsigned int rand_interval(unsigned int min, unsigned int max);
+static void begin_read();
+static void end_read();
 
 int main(int argc, char* argv[])
 {
     int team, id_spaceship;
+    char name[2 * MAX_CHAR_ID + 12];
     command_t cmd;
-    spaceship_t spaceship, attacked_spaceship;
+    spaceship_t spaceship;
     move_t move;
-    int posx, posy, x, y;
-    int sval;
+    map_t* view; // Map the decision is taken on
+    unsigned int seed;
+    int coalesced = 0; // Moves not sent since the last one that was
+    bool found;
+    uint64_t span, step;
 
-    if (argc != 3) {
+    if (argc != 3 && argc != 4) {
         fprintf(stderr, "[SPACESHIP] Wrong number of arguments...\n");
         exit(EXIT_FAILURE);
     }
+    if (!ipc_names_init(&ipc_names, (argc == 4) ? argv[3] : NULL)) {
+        fprintf(stderr, "[SPACESHIP] Invalid instance id...\n");
+        exit(EXIT_FAILURE);
+    }
 
     team = atoi(argv[1]);
     id_spaceship = atoi(argv[2]);
+    snprintf(name,
+             sizeof(name),
+             "spaceship %c%d",
+             team_symbols[team % N_TEAMS],
+             id_spaceship);
+    trace_init(name);
 
     // Init resources
     if (!init_shared_resources(team, id_spaceship)) {
@@ -49,124 +78,114 @@ int main(int argc, char* argv[])
     }
 
     // Main loop
-    srandom(time(NULL));
+    seed = time(NULL) ^ getpid();
     while (1) {
         fprintf(stdout,
                 "[SPACESHIP %d/%d] Reading message from PIPE...\n",
                 team,
                 id_spaceship);
         read(STDIN_FILENO, &cmd, sizeof(command_t));
+        span = trace_begin();
+        trace_flow_end(cmd.flow);
         if (cmd.type == DESTROY) {
+            trace_end("DESTROY", span, id_spaceship);
             break;
         }
 
-        // Check if the map is being used by the main process
-        sem_wait(sem_mutex);
-        sem_wait(sem_r);
-        sem_post(sem_count_r);
-        sem_getvalue(sem_count_r, &sval);
-        if (sval == 1) {
-            sem_wait(sem_w);
-        }
-        sem_post(sem_r);
-        sem_post(sem_mutex);
-
-        // Process the command receive from the team leader
-        spaceship = map_get_spaceship(pmap, team, id_spaceship);
-        switch (cmd.type) {
-            case ATTACK:
-                fprintf(stdout,
-                        "[SPACESHIP %d/%d] Attacking...\n",
-                        team,
-                        id_spaceship);
-                attacked_spaceship = locate_enemy_spaceship(pmap, spaceship);
-                if (attacked_spaceship.id == -1) {
-                    fprintf(stdout,
-                            "[SPACESHIP %d/%d] Cannot find any spaceship to "
-                            "attack...\n",
-                            team,
-                            id_spaceship);
-                    sem_wait(sem_count_r);
-                    sem_getvalue(sem_count_r, &sval);
-                    if (sval == 0) {
-                        sem_post(sem_w);
-                    }
-                    continue;
-                } else {
-                    fprintf(
-                      stdout,
-                      "[SPACESHIP %d/%d] Sending ATTACK move to %d %d...\n",
-                      team,
-                      id_spaceship,
-                      attacked_spaceship.team,
-                      attacked_spaceship.id);
-                    move.objetiveX = attacked_spaceship.posx;
-                    move.objetiveY = attacked_spaceship.posy;
-                }
-                break;
-            case MOVE:
+        // Pipelined, we decide on the last committed turn without the lock
+        // while the simulator resolves the moves of the previous one
+        if (pmap->pipelined) {
+            if (!snapshot_read(psnapshot, &committed)) {
                 fprintf(stdout,
-                        "[SPACESHIP %d/%d] Looking for a position to move...\n",
+                        "[SPACESHIP %d/%d] No committed turn to decide on...\n",
                         team,
                         id_spaceship);
-                // Calculate a random position to move
-                while (1) {
-                    posx = spaceship.posx;
-                    posy = spaceship.posy;
-                    x = rand() % 3;
-                    y = rand() % 3;
-                    if (x == 0) {
-                        posx--;
-                    } else if (x == 1) {
-                        posx++;
-                    }
-                    if (y == 0) {
-                        posy--;
-                    } else if (y == 1) {
-                        posy++;
-                    }
-                    // Check if the position is out of the map
-                    if (posx > (MAP_MAX_X - 1) || posx < 0 ||
-                        posy > (MAP_MAX_Y - 1) || posy < 0) {
-                        continue;
-                    }
-                    // Check if it is possible to move
-                    if (map_is_square_empty(pmap, posx, posy) ||
-                        // Case: Not movement
-                        (x == 2 && y == 2)) {
-                        break;
-                    }
-                }
-                fprintf(stdout,
-                        "[SPACESHIP %d/%d] Sending MOVE move to %d %d...\n",
-                        team,
-                        id_spaceship,
-                        posx,
-                        posy);
-                move.objetiveX = posx;
-                move.objetiveY = posy;
-                break;
+                trace_end("command", span, cmd.type);
+                continue;
+            }
+            view = &committed;
+        } else {
+            // Check if the map is being used by the main process
+            step = trace_begin();
+            begin_read();
+            trace_end("lock", step, id_spaceship);
+            view = pmap;
         }
 
-        sem_wait(sem_count_r);
-        sem_getvalue(sem_count_r, &sval);
-        if (sval == 0) {
-            sem_post(sem_w);
+        // Process the command receive from the team leader
+        spaceship = map_get_spaceship(view, team, id_spaceship);
+        if (cmd.type == ATTACK) {
+            fprintf(
+              stdout, "[SPACESHIP %d/%d] Attacking...\n", team, id_spaceship);
+        } else {
+            fprintf(stdout,
+                    "[SPACESHIP %d/%d] Looking for a position to move...\n",
+                    team,
+                    id_spaceship);
+        }
+        step = trace_begin();
+        if (cmd.type == ATTACK) {
+            // The target chosen by the leader, if it is still valid
+            found = ai_spaceship_attack(view,
+                                        spaceship,
+                                        cmd.target_team,
+                                        cmd.target_id,
+                                        &move,
+                                        &seed);
+        } else {
+            found = ai_spaceship_move(view, spaceship, cmd.type, &move, &seed);
+        }
+        trace_end("decide", step, cmd.type);
+        if (!found) {
+            fprintf(stdout,
+                    "[SPACESHIP %d/%d] Cannot find any spaceship to "
+                    "attack...\n",
+                    team,
+                    id_spaceship);
+            if (view == pmap) {
+                end_read();
+            }
+            trace_end("command", span, cmd.type);
+            continue;
+        }
+        fprintf(stdout,
+                "[SPACESHIP %d/%d] Sending %s move to %d %d...\n",
+                team,
+                id_spaceship,
+                (move.type == SPLASH)   ? "SPLASH"
+                : (cmd.type == ATTACK) ? "ATTACK"
+                                       : "MOVE",
+                move.objetiveX,
+                move.objetiveY);
+
+        if (view == pmap) {
+            end_read();
         }
 
         // Send the move to the simulator process
-        move.type = cmd.type;
-        move.originX = spaceship.posx;
-        move.originY = spaceship.posy;
-        move.id_spaceship = id_spaceship;
-        move.team = team;
         fprintf(stdout,
                 "[SPACESHIP %d/%d] Sending message through the queue...\n",
                 team,
                 id_spaceship);
-        if (mq_send(queue, (char*)&move, sizeof(move), 1) == -1) {
+        move.coalesced = coalesced;
+        step = trace_begin();
+        move.flow = trace_flow_start();
+        found = mq_send(queue, (char*)&move, sizeof(move), 1) == 0;
+        trace_end("mq_send", step, coalesced);
+        if (found) {
+            coalesced = 0;
+        } else if (errno == EAGAIN) {
+            // The queue of the team is full. The next move replaces this one
+            // instead of adding more load.
+            fprintf(stdout,
+                    "[SPACESHIP %d/%d] Queue full, move rejected...\n",
+                    team,
+                    id_spaceship);
+            coalesced++;
+        } else {
             perror("[SPACESHIP] Error sending message through the queue...\n");
         }
+        trace_end("command", span, cmd.type);
     } // main loop
 
     fprintf(
@@ -185,17 +204,25 @@ static status init_shared_resources(int team, int id_spaceship)
             "[SPACESHIP %d/%d] Managing shared memory...\n",
             team,
             id_spaceship);
-    fd_shm_map = shm_open(SHM_MAP_NAME, O_RDONLY, 0);
-    if (fd_shm_map == -1) {
+    if (!shm_region_attach(&shm_map,
+                           ipc_names.shm_map,
+                           sizeof(map_t),
+                           PROT_READ,
+                           SHM_PREFAULT)) {
         perror("[SPACESHIP] Error opening the shared memory...\n");
         return ERROR;
     }
-
-    pmap =
-      (map_t*)mmap(NULL, sizeof(map_t), PROT_READ, MAP_SHARED, fd_shm_map, 0);
-    if (pmap == MAP_FAILED) {
-        perror("[SPACESHIP] Error mapping the shared memory...\n");
-        return ERROR;
+    pmap = (map_t*)shm_map.addr;
+    if (pmap->pipelined) {
+        if (!shm_region_attach(&shm_snapshot,
+                               ipc_names.shm_snapshot,
+                               sizeof(snapshot_t),
+                               PROT_READ,
+                               0)) {
+            perror("[SPACESHIP] Error opening the snapshot...\n");
+            return ERROR;
+        }
+        psnapshot = (snapshot_t*)shm_snapshot.addr;
     }
 
     // Queue
@@ -203,7 +230,7 @@ static status init_shared_resources(int team, int id_spaceship)
             "[SPACESHIP %d/%d] Managing message queue...\n",
             team,
             id_spaceship);
-    queue = mq_open(MQ_ACTION_NAME, O_WRONLY);
+    queue = mq_open(ipc_names.mq_actions[team], O_WRONLY | O_NONBLOCK);
     if (queue == (mqd_t)-1) {
         perror("[SPACESHIP] Error creating the queue...\n");
         return ERROR;
@@ -212,25 +239,25 @@ static status init_shared_resources(int team, int id_spaceship)
     // Semapthores
     fprintf(
       stdout, "[SPACESHIP %d/%d] Managing semaphores...\n", team, id_spaceship);
-    sem_w = sem_open(SEM_W_NAME, O_RDWR);
+    sem_w = sem_open(ipc_names.sem_w, O_RDWR);
     if (sem_w == SEM_FAILED) {
         perror("[SPACESHIP] Error opening the semaphore sem_w..\n");
         return ERROR;
     }
 
-    sem_r = sem_open(SEM_R_NAME, O_RDWR);
+    sem_r = sem_open(ipc_names.sem_r, O_RDWR);
     if (sem_r == SEM_FAILED) {
         perror("[SPACESHIP] Error opening the semaphore sem_r...\n");
         return ERROR;
     }
 
-    sem_mutex = sem_open(SEM_MUTEX_R_NAME, O_RDWR);
+    sem_mutex = sem_open(ipc_names.sem_mutex, O_RDWR);
     if (sem_mutex == SEM_FAILED) {
         perror("[SPACESHIP] Error opening the semaphore sem_mutex...\n");
         return ERROR;
     }
 
-    sem_count_r = sem_open(SEM_COUNT_R_NAME, O_RDWR);
+    sem_count_r = sem_open(ipc_names.sem_count_r, O_RDWR);
     if (sem_count_r == SEM_FAILED) {
         perror("[SPACESHIP] Error opening the semaphore sem_count_r...\n");
         return ERROR;
@@ -276,7 +303,9 @@ static void free_resources()
     sem_close(sem_r);
     sem_close(sem_mutex);
     sem_close(sem_count_r);
-    munmap(pmap, sizeof(map_t));
+    shm_region_detach(&shm_snapshot);
+    shm_region_detach(&shm_map);
+    trace_flush();
 }
 
 static void handler_SIGTERM(int signal)
@@ -286,53 +315,30 @@ static void handler_SIGTERM(int signal)
     exit(EXIT_SUCCESS);
 }
 
-static unsigned int rand_interval(unsigned int min, unsigned int max)
+/* Readers protocol of the map: the first reader locks out the writer and
+ * the last one lets it in. */
+static void begin_read()
 {
-    int r;
-    const unsigned int range = 1 + max - min;
-    const unsigned int buckets = RAND_MAX / range;
-    const unsigned int limit = buckets * range;
-
-    do {
-        r = random();
-    } while (r >= limit);
+    int sval;
 
-    return min + (r / buckets);
+    sem_wait(sem_mutex);
+    sem_wait(sem_r);
+    sem_post(sem_count_r);
+    sem_getvalue(sem_count_r, &sval);
+    if (sval == 1) {
+        sem_wait(sem_w);
+    }
+    sem_post(sem_r);
+    sem_post(sem_mutex);
 }
 
-static spaceship_t locate_enemy_spaceship(map_t* pmap, spaceship_t spaceship)
+static void end_read()
 {
-    int i, k;
-    int enemy_team, enemy_spaceship_id;
-    spaceship_t attacked_spaceship;
-
-    for (k = 0; k < N_TEAMS; k++) {
-        // Select a random team
-        enemy_team = rand_interval(0, N_TEAMS - 1);
-        if (enemy_team == spaceship.team ||
-            map_get_num_spaceships(pmap, enemy_team) == 0) {
-            continue;
-        }
-        // Search for any reachable enemy spaceship
-        for (i = 0; i < N_SPACESHIPS; i++) {
-            enemy_spaceship_id = rand_interval(0, N_SPACESHIPS - 1);
-            attacked_spaceship =
-              map_get_spaceship(pmap, enemy_team, enemy_spaceship_id);
-            if (!attacked_spaceship.alive) {
-                continue;
-            }
-            if (map_get_distance(pmap,
-                                 spaceship.posy,
-                                 spaceship.posx,
-                                 attacked_spaceship.posy,
-                                 attacked_spaceship.posx) <= MAX_ATACK_SCOPE) {
-                return attacked_spaceship;
-            }
-        }
-    }
-
-    // Not found an enemy spaceship in range or alive
-    attacked_spaceship.id = -1;
+    int sval;
 
-    return attacked_spaceship;
+    sem_wait(sem_count_r);
+    sem_getvalue(sem_count_r, &sval);
+    if (sval == 0) {
+        sem_post(sem_w);
+    }
 }
@@ -0,0 +1,376 @@
+#define _GNU_SOURCE    // sched_setaffinity
+#include <sched.h>     // sched_setaffinity
+#include <stdint.h>    // uint64_t
+#include <stdio.h>     // fprintf, perror
+#include <stdlib.h>    // exit, calloc
+#include <string.h>    // memset
+#include <time.h>      // clock_gettime
+#include <unistd.h>    // fork, pipe, sysconf
+#include <wait.h>      // waitpid
+
+#include "ai.h"
+#include "flowfield.h"
+#include "game.h"
+#include "kinetic.h"
+#include "map.h"
+#include "scenario.h"
+#include "simulator.h"
+
+#define TOURNAMENT_MATCHES 1000
+#define TOURNAMENT_MAX_TURNS 1000 // A match that lasts more is a draw
+#define TOURNAMENT_RESULTS "tournament.csv"
+
+extern char team_symbols[N_TEAMS];
+
+/* Written by the workers through a pipe. It is smaller than PIPE_BUF so
+ * writes of several workers never interleave. */
+typedef struct {
+    int match;
+    unsigned int seed;
+    int winner; // -1 if it was a draw
+    int turns;
+    long moves;
+    long usec;
+    uint64_t hash; // Final state, equal runs of a seed must agree on it
+} result_t;
+
+static void run_worker(int worker,
+                       int n_workers,
+                       int n_matches,
+                       unsigned int base_seed,
+                       int max_turns,
+                       int sensor_range,
+                       bool splash,
+                       bool continuous,
+                       scenario_t* scenario,
+                       int fd);
+static void run_match(map_t* map,
+                      int max_turns,
+                      int sensor_range,
+                      scenario_t* scenario,
+                      result_t* result);
+static long elapsed_usec(struct timespec* start);
+
+int main(int argc, char* argv[])
+{
+    int i, opt;
+    int n_matches = TOURNAMENT_MATCHES;
+    int n_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_turns = TOURNAMENT_MAX_TURNS;
+    int sensor_range = SENSOR_RANGE;
+    bool splash = false;
+    bool continuous = false;
+    unsigned int base_seed = time(NULL);
+    char* results_path = TOURNAMENT_RESULTS;
+    int fd_pipe[2];
+    pid_t pid;
+    FILE* results;
+    result_t result;
+    int wins[N_TEAMS + 1] = { 0 }; // Last one counts the draws
+    long turns_to_victory = 0, total_turns = 0, total_moves = 0;
+    long total_usec = 0;
+    struct timespec start;
+    long wall_usec;
+    scenario_t scenario;
+    scenario_t* pscenario = NULL; // Open map if there is no scenario
+
+    while ((opt = getopt(argc, argv, "n:j:s:t:S:m:o:wc")) != -1) {
+        switch (opt) {
+            case 'n':
+                n_matches = atoi(optarg);
+                break;
+            case 'j':
+                n_workers = atoi(optarg);
+                break;
+            case 's':
+                base_seed = strtoul(optarg, NULL, 10);
+                break;
+            case 't':
+                max_turns = atoi(optarg);
+                break;
+            case 'S':
+                sensor_range = atoi(optarg);
+                break;
+            case 'm':
+                if (!scenario_load(&scenario, optarg)) {
+                    exit(EXIT_FAILURE);
+                }
+                pscenario = &scenario;
+                break;
+            case 'o':
+                results_path = optarg;
+                break;
+            case 'w':
+                splash = true;
+                break;
+            case 'c':
+                continuous = true;
+                break;
+            default:
+                fprintf(stderr,
+                        "Usage: %s [-n matches] [-j workers] [-s seed] "
+                        "[-t max_turns] [-S sensor_range] [-m scenario] "
+                        "[-o results] [-w] [-c]\n",
+                        argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (n_matches <= 0 || n_workers <= 0 || max_turns <= 0 ||
+        sensor_range < 0) {
+        fprintf(stderr, "[TOURNAMENT] Invalid arguments...\n");
+        exit(EXIT_FAILURE);
+    }
+    if (n_workers > n_matches) {
+        n_workers = n_matches;
+    }
+    // The workers inherit the kernels of the playable area
+    if (pscenario) {
+        map_set_area(pscenario->height, pscenario->width);
+    }
+
+    results = fopen(results_path, "w");
+    if (!results) {
+        perror("[TOURNAMENT] Error creating the results file...\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (pipe(fd_pipe) == -1) {
+        perror("[TOURNAMENT] Error creating the pipe...\n");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stdout,
+            "[TOURNAMENT] %d matches in %d workers from seed %u...\n",
+            n_matches,
+            n_workers,
+            base_seed);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    // Or the workers would write what is buffered again when they exit
+    fflush(stdout);
+    fflush(results);
+
+    // Every worker runs its own share of matches without any shared state
+    for (i = 0; i < n_workers; i++) {
+        pid = fork();
+        if (pid < 0) {
+            perror("[TOURNAMENT]: fork");
+            exit(EXIT_FAILURE);
+        } else if (pid == 0) {
+            close(fd_pipe[READ]);
+            run_worker(i,
+                       n_workers,
+                       n_matches,
+                       base_seed,
+                       max_turns,
+                       sensor_range,
+                       splash,
+                       continuous,
+                       pscenario,
+                       fd_pipe[WRITE]);
+        }
+    }
+    close(fd_pipe[WRITE]);
+
+    fprintf(results, "match,seed,winner,turns,moves,usec,turns_per_sec,hash\n");
+    while (read(fd_pipe[READ], &result, sizeof(result)) == sizeof(result)) {
+        fprintf(results,
+                "%d,%u,%c,%d,%ld,%ld,%.1f,%016llx\n",
+                result.match,
+                result.seed,
+                (result.winner >= 0) ? team_symbols[result.winner] : '-',
+                result.turns,
+                result.moves,
+                result.usec,
+                result.turns * 1e6 / (result.usec ? result.usec : 1),
+                (unsigned long long)result.hash);
+        if (result.winner >= 0) {
+            wins[result.winner]++;
+            turns_to_victory += result.turns;
+        } else {
+            wins[N_TEAMS]++;
+        }
+        total_turns += result.turns;
+        total_moves += result.moves;
+        total_usec += result.usec;
+    }
+    close(fd_pipe[READ]);
+
+    for (i = 0; i < n_workers; i++) {
+        wait(NULL);
+    }
+    wall_usec = elapsed_usec(&start);
+
+    // Summary, after the rows so it can be skipped as comments
+    for (i = 0; i < N_TEAMS; i++) {
+        fprintf(results,
+                "# win_rate %c %.4f\n",
+                team_symbols[i],
+                (double)wins[i] / n_matches);
+    }
+    fprintf(results, "# draw_rate %.4f\n", (double)wins[N_TEAMS] / n_matches);
+    fprintf(results,
+            "# mean_turns_to_victory %.2f\n",
+            (n_matches > wins[N_TEAMS])
+              ? (double)turns_to_victory / (n_matches - wins[N_TEAMS])
+              : 0.0);
+    fprintf(results,
+            "# mean_match_turns_per_sec %.1f\n",
+            total_turns * 1e6 / (total_usec ? total_usec : 1));
+    fprintf(results,
+            "# matches_per_sec %.1f\n",
+            n_matches * 1e6 / (wall_usec ? wall_usec : 1));
+    fprintf(results,
+            "# moves_per_sec %.1f\n",
+            total_moves * 1e6 / (wall_usec ? wall_usec : 1));
+    fclose(results);
+
+    fprintf(stdout,
+            "[TOURNAMENT] %d matches in %.3f s (%.1f matches/s), results in "
+            "%s...\n",
+            n_matches,
+            wall_usec / 1e6,
+            n_matches * 1e6 / (wall_usec ? wall_usec : 1),
+            results_path);
+
+    exit(EXIT_SUCCESS);
+}
+
+static void run_worker(int worker,
+                       int n_workers,
+                       int n_matches,
+                       unsigned int base_seed,
+                       int max_turns,
+                       int sensor_range,
+                       bool splash,
+                       bool continuous,
+                       scenario_t* scenario,
+                       int fd)
+{
+    int i;
+    map_t* map;
+    result_t result;
+    cpu_set_t cpus;
+
+    // One worker per core, so they do not fight for the same one
+    CPU_ZERO(&cpus);
+    CPU_SET(worker % sysconf(_SC_NPROCESSORS_ONLN), &cpus);
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+
+    map = calloc(1, sizeof(map_t));
+    if (!map) {
+        perror("[TOURNAMENT] calloc");
+        exit(EXIT_FAILURE);
+    }
+    map->splash = splash;
+    map->continuous = continuous;
+
+    for (i = worker; i < n_matches; i += n_workers) {
+        memset(&result, 0, sizeof(result));
+        result.match = i;
+        result.seed = base_seed + i;
+        run_match(map, max_turns, sensor_range, scenario, &result);
+        if (write(fd, &result, sizeof(result)) != sizeof(result)) {
+            perror("[TOURNAMENT] Error sending the result...\n");
+            break;
+        }
+    }
+
+    free(map);
+    close(fd);
+    exit(EXIT_SUCCESS);
+}
+
+/* Plays a whole match in this process. The leaders and the spaceships take
+ * the same decisions as their processes, and the moves of a turn are applied
+ * in round robin between the teams. */
+static void run_match(map_t* map,
+                      int max_turns,
+                      int sensor_range,
+                      scenario_t* scenario,
+                      result_t* result)
+{
+    int i, j, k;
+    int turn, action;
+    unsigned int seed = result->seed;
+    int actions[N_TEAMS];
+    spaceship_t targets[N_TEAMS][N_SPACESHIPS];
+    spaceship_t spaceship, target;
+    spaceship_t victims[N_TEAMS * N_SPACESHIPS];
+    move_t move;
+    blasts_t blasts = { 0 };
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    map_set_sensor_range(map, sensor_range);
+    game_init_map(map, scenario, &seed);
+    flowfield_update(map);
+    if (map->splash) {
+        map_update_occupancy(map);
+    }
+
+    result->winner = -1;
+    for (turn = 1; turn <= max_turns; turn++) {
+        for (k = 0; k < N_ACTIONS_LEADER; k++) {
+            for (i = 0; i < N_TEAMS; i++) {
+                actions[i] = ai_leader_action(&seed);
+                if (actions[i] == ATTACK) {
+                    ai_assign_targets(map, i, targets[i]);
+                }
+            }
+            for (j = 0; j < N_SPACESHIPS; j++) {
+                for (i = 0; i < N_TEAMS; i++) {
+                    spaceship = map_get_spaceship(map, i, j);
+                    action = actions[i];
+                    if (!spaceship.alive) {
+                        continue;
+                    }
+                    if (action == ATTACK
+                          ? !ai_spaceship_attack(map,
+                                                 spaceship,
+                                                 targets[i][j].team,
+                                                 targets[i][j].id,
+                                                 &move,
+                                                 &seed)
+                          : !ai_spaceship_move(
+                              map, spaceship, action, &move, &seed)) {
+                        continue;
+                    }
+                    if (game_process_move(map, move, &target) ==
+                        OUTCOME_LAUNCHED) {
+                        game_add_blast(&blasts, move);
+                    }
+                    result->moves++;
+                }
+            }
+        }
+        game_resolve_blasts(map, &blasts, victims);
+        if (map->continuous) {
+            kinetic_advance(map);
+        }
+        map_restore(map);
+        flowfield_update(map);
+        if (map->splash) {
+            map_update_occupancy(map);
+        }
+
+        i = game_get_winner(map);
+        if (i >= 0) {
+            result->winner = (i < N_TEAMS) ? i : -1;
+            break;
+        }
+    }
+
+    result->turns = (turn > max_turns) ? max_turns : turn;
+    result->hash = map->hash;
+    result->usec = elapsed_usec(&start);
+}
+
+static long elapsed_usec(struct timespec* start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1000000L +
+           (now.tv_nsec - start->tv_nsec) / 1000;
+}